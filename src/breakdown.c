@@ -0,0 +1,138 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+/* For RUSAGE_THREAD */
+#define _GNU_SOURCE
+
+#include "sandglass-impl.h"
+#include "sandglass.h"
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+
+/*
+ * Store the current readings of every clock.  getrusage() is called first when
+ * beginning and last when elapsing, to keep its overhead out of the measured
+ * interval.
+ */
+static int sandglass_breakdown_sample(sandglass_breakdown_t *breakdown,
+                                      int begin, double *wall, double *cpu);
+
+/* Start timing */
+int
+sandglass_breakdown_begin(sandglass_breakdown_t *breakdown)
+{
+  return sandglass_breakdown_sample(breakdown, 1,
+                                    &breakdown->wall, &breakdown->oncpu);
+}
+
+/* Finish timing */
+int
+sandglass_breakdown_elapse(sandglass_breakdown_t *breakdown)
+{
+  sandglass_breakdown_t old = *breakdown;
+  double wall, cpu;
+
+  if (sandglass_breakdown_sample(breakdown, 0, &wall, &cpu) != 0)
+    return -1;
+
+  breakdown->wall   = wall - old.wall;
+  breakdown->oncpu  = cpu - old.oncpu;
+  breakdown->offcpu = breakdown->wall - breakdown->oncpu;
+  if (breakdown->offcpu < 0.0)
+    /* The clocks have different granularities */
+    breakdown->offcpu = 0.0;
+
+  breakdown->voluntary   -= old.voluntary;
+  breakdown->involuntary -= old.involuntary;
+  breakdown->minflt      -= old.minflt;
+  breakdown->majflt      -= old.majflt;
+  return 0;
+}
+
+/* Get the resource usage of the calling thread, if possible */
+static int
+sandglass_getrusage(struct rusage *usage)
+{
+#ifdef RUSAGE_THREAD
+  return getrusage(RUSAGE_THREAD, usage);
+#else
+  return getrusage(RUSAGE_SELF, usage);
+#endif
+}
+
+/* Get the value of a clock in seconds */
+static int
+sandglass_clock_seconds(clockid_t clock_id, double *seconds)
+{
+  struct timespec ts;
+  if (clock_gettime(clock_id, &ts) != 0)
+    return -1;
+  *seconds = ts.tv_sec + ts.tv_nsec/1e9;
+  return 0;
+}
+
+/* Read the clock values and resource usage */
+static int
+sandglass_breakdown_sample(sandglass_breakdown_t *breakdown,
+                           int begin, double *wall, double *cpu)
+{
+  struct rusage usage;
+  clockid_t wall_id, cpu_id;
+
+  if (sysconf(_SC_MONOTONIC_CLOCK) > 0) {
+    wall_id = CLOCK_MONOTONIC;
+  } else {
+    wall_id = CLOCK_REALTIME;
+  }
+
+  if (sysconf(_SC_THREAD_CPUTIME) > 0) {
+    cpu_id = CLOCK_THREAD_CPUTIME_ID;
+  } else if (sysconf(_SC_CPUTIME) > 0) {
+    cpu_id = CLOCK_PROCESS_CPUTIME_ID;
+  } else {
+    errno = ENOTSUP;
+    return -1;
+  }
+
+  if (begin) {
+    if (sandglass_getrusage(&usage) != 0)
+      return -1;
+    if (sandglass_clock_seconds(cpu_id, cpu) != 0)
+      return -1;
+    if (sandglass_clock_seconds(wall_id, wall) != 0)
+      return -1;
+  } else {
+    if (sandglass_clock_seconds(wall_id, wall) != 0)
+      return -1;
+    if (sandglass_clock_seconds(cpu_id, cpu) != 0)
+      return -1;
+    if (sandglass_getrusage(&usage) != 0)
+      return -1;
+  }
+
+  breakdown->voluntary   = usage.ru_nvcsw;
+  breakdown->involuntary = usage.ru_nivcsw;
+  breakdown->minflt      = usage.ru_minflt;
+  breakdown->majflt      = usage.ru_majflt;
+  return 0;
+}
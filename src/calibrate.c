@@ -0,0 +1,283 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#define _GNU_SOURCE
+#include "sandglass-impl.h"
+#include "sandglass.h"
+#include <sys/utsname.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Number of measurements to take the minimum of */
+#define SANDGLASS_CALIBRATION_SAMPLES 1000
+
+/* Identifies the calibration file format */
+#define SANDGLASS_CALIBRATION_HEADER "libsandglass-calibration 1"
+
+/* The measured overhead of one clock */
+typedef struct sandglass_calibration_t
+{
+  int calibrated;
+
+  /* Overhead of sandglass_begin()/_elapse(), in grains */
+  long overhead;
+
+  /* Cost of one iteration of the sandglass_bench_fine() loop, in grains */
+  double per_loop;
+} sandglass_calibration_t;
+
+/* Calibrations for each clock, indexed by incrementation and resolution */
+static sandglass_calibration_t sandglass_calibrations[2][2];
+
+/* Whether we've tried loading the calibration file */
+static int sandglass_calibrations_loaded = 0;
+
+static pthread_mutex_t sandglass_calibration_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+const char *
+sandglass_secure_getenv(const char *name)
+{
+#if HAVE_SECURE_GETENV
+  return secure_getenv(name);
+#else
+  if (getuid() != geteuid() || getgid() != getegid())
+    return NULL;
+  return getenv(name);
+#endif
+}
+
+/* Read the first line of path starting with prefix, after the prefix */
+static int
+sandglass_read_line(const char *path, const char *prefix,
+                    char *buf, size_t size)
+{
+  char line[256];
+  size_t len = strlen(prefix);
+  FILE *file = fopen(path, "r");
+  int ret = -1;
+
+  if (!file)
+    return -1;
+
+  while (fgets(line, sizeof(line), file)) {
+    if (strncmp(line, prefix, len) == 0) {
+      line[strcspn(line, "\n")] = '\0';
+      snprintf(buf, size, "%s", line + len);
+      ret = 0;
+      break;
+    }
+  }
+
+  fclose(file);
+  return ret;
+}
+
+/* /proc/cpuinfo lines naming the CPU model, on various architectures */
+static const char *sandglass_cpuinfo_prefixes[] = {
+  "model name\t: ", /* x86 */
+  "Processor\t: ",  /* 32-bit ARM */
+  "CPU part\t: ",   /* 64-bit ARM */
+  "cpu\t\t: ",      /* PowerPC */
+  NULL
+};
+
+/*
+ * Describe the machine the calibrations are valid for: the CPU model, and the
+ * boot ID, since TSC frequencies and kernel clock paths can change across
+ * reboots
+ */
+static int
+sandglass_calibration_key(char *cpu, size_t cpu_size,
+                          char *boot, size_t boot_size)
+{
+  const char **prefix;
+  struct utsname name;
+
+  for (prefix = sandglass_cpuinfo_prefixes; *prefix; ++prefix) {
+    if (sandglass_read_line("/proc/cpuinfo", *prefix, cpu, cpu_size) == 0)
+      break;
+  }
+  if (!*prefix) {
+    /* The boot ID still pins us to this machine; settle for the arch */
+    if (uname(&name) != 0)
+      return -1;
+    snprintf(cpu, cpu_size, "%s", name.machine);
+  }
+
+  if (sandglass_read_line("/proc/sys/kernel/random/boot_id", "",
+                          boot, boot_size) != 0)
+    return -1;
+  return 0;
+}
+
+/* Load saved calibrations, if they match this machine */
+static void
+sandglass_calibrations_load(const char *path)
+{
+  char cpu[256], boot[64], line[512];
+  sandglass_calibration_t calibration;
+  int incrementation, resolution, valid = 0;
+  FILE *file;
+
+  if (sandglass_calibration_key(cpu, sizeof(cpu), boot, sizeof(boot)) != 0)
+    return;
+
+  file = fopen(path, "r");
+  if (!file)
+    return;
+
+  while (fgets(line, sizeof(line), file)) {
+    line[strcspn(line, "\n")] = '\0';
+
+    if (valid < 3) {
+      /* Check the header and key, in order */
+      if ((valid == 0 && strcmp(line, SANDGLASS_CALIBRATION_HEADER) == 0)
+          || (valid == 1 && strncmp(line, "cpu ", 4) == 0
+              && strcmp(line + 4, cpu) == 0)
+          || (valid == 2 && strncmp(line, "boot ", 5) == 0
+              && strcmp(line + 5, boot) == 0)) {
+        ++valid;
+        continue;
+      }
+      break;
+    }
+
+    if (sscanf(line, "clock %d %d %ld %lg", &incrementation, &resolution,
+               &calibration.overhead, &calibration.per_loop) == 4
+        && incrementation >= 0 && incrementation < 2
+        && resolution >= 0 && resolution < 2) {
+      calibration.calibrated = 1;
+      sandglass_calibrations[incrementation][resolution] = calibration;
+    }
+  }
+
+  fclose(file);
+}
+
+/* Save our calibrations, replacing the file atomically */
+static void
+sandglass_calibrations_save(const char *path)
+{
+  char cpu[256], boot[64], tmp[4096];
+  int incrementation, resolution;
+  sandglass_calibration_t *calibration;
+  FILE *file;
+
+  if (sandglass_calibration_key(cpu, sizeof(cpu), boot, sizeof(boot)) != 0)
+    return;
+
+  if (snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid())
+      >= (int)sizeof(tmp))
+    return;
+
+  file = fopen(tmp, "w");
+  if (!file)
+    return;
+
+  fprintf(file, "%s\n", SANDGLASS_CALIBRATION_HEADER);
+  fprintf(file, "cpu %s\n", cpu);
+  fprintf(file, "boot %s\n", boot);
+  for (incrementation = 0; incrementation < 2; ++incrementation) {
+    for (resolution = 0; resolution < 2; ++resolution) {
+      calibration = &sandglass_calibrations[incrementation][resolution];
+      if (calibration->calibrated) {
+        fprintf(file, "clock %d %d %ld %.17g\n", incrementation, resolution,
+                calibration->overhead, calibration->per_loop);
+      }
+    }
+  }
+
+  if (fclose(file) != 0 || rename(tmp, path) != 0)
+    remove(tmp);
+}
+
+/* Measure the overhead of sandglass's clock */
+static int
+sandglass_measure(sandglass_t *sandglass,
+                  sandglass_calibration_t *calibration)
+{
+  long overhead = -1, loop = -1;
+  int i;
+
+  /* The minimum over many samples is the cost without interference */
+  for (i = 0; i < SANDGLASS_CALIBRATION_SAMPLES; ++i) {
+    if (sandglass_begin(sandglass) != 0 || sandglass_elapse(sandglass) != 0)
+      return -1;
+    if (overhead < 0 || sandglass->grains < overhead)
+      overhead = sandglass->grains;
+  }
+
+  /* Time the same empty loop as sandglass_bench_fine() */
+  for (i = 0; i < SANDGLASS_CALIBRATION_SAMPLES; ++i) {
+    if (sandglass_begin(sandglass) != 0)
+      return -1;
+    for (sandglass->i = 0; sandglass->i < sandglass->loops; ++sandglass->i) {
+      SANDGLASS_NO_UNROLL();
+    }
+    if (sandglass_elapse(sandglass) != 0)
+      return -1;
+    if (loop < 0 || sandglass->grains < loop)
+      loop = sandglass->grains;
+  }
+
+  calibration->overhead = overhead;
+  calibration->per_loop = (double)(loop - overhead)/sandglass->loops;
+  if (calibration->per_loop < 0.0)
+    calibration->per_loop = 0.0;
+  calibration->calibrated = 1;
+  return 0;
+}
+
+int
+sandglass_calibrate(sandglass_t *sandglass)
+{
+  /* Don't let the caller of a setuid program overwrite arbitrary files */
+  const char *path = sandglass_secure_getenv("SANDGLASS_CALIBRATION_FILE");
+  sandglass_calibration_t *calibration
+    = &sandglass_calibrations[sandglass->incrementation][sandglass->resolution];
+  int ret = 0;
+
+  pthread_mutex_lock(&sandglass_calibration_mutex);
+
+  if (!sandglass_calibrations_loaded) {
+    if (path)
+      sandglass_calibrations_load(path);
+    sandglass_calibrations_loaded = 1;
+  }
+
+  if (!calibration->calibrated) {
+    ret = sandglass_measure(sandglass, calibration);
+    if (ret == 0 && path)
+      sandglass_calibrations_save(path);
+  }
+
+  if (ret == 0) {
+    sandglass->baseline      = calibration->overhead;
+    sandglass->loop_baseline = calibration->overhead
+                               + (long)(calibration->per_loop*sandglass->loops
+                                        + 0.5);
+  }
+
+  pthread_mutex_unlock(&sandglass_calibration_mutex);
+  return ret;
+}
@@ -0,0 +1,111 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "sandglass-impl.h"
+#include "sandglass.h"
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+volatile unsigned long sandglass_categories = 0;
+
+/* The categories to restore when toggled back on by a signal */
+static volatile unsigned long sandglass_toggled = SANDGLASS_ALL_CATEGORIES;
+
+void
+sandglass_enable(unsigned long categories)
+{
+  __atomic_fetch_or(&sandglass_categories, categories, __ATOMIC_RELAXED);
+}
+
+void
+sandglass_disable(unsigned long categories)
+{
+  __atomic_fetch_and(&sandglass_categories, ~categories, __ATOMIC_RELAXED);
+}
+
+/* Toggle all instrumentation */
+static void
+sandglass_toggle(int signum)
+{
+  unsigned long categories;
+
+  (void)signum;
+
+  /* Atomic, since other threads may be calling sandglass_enable() */
+  categories = __atomic_exchange_n(&sandglass_categories, 0, __ATOMIC_RELAXED);
+  if (categories) {
+    sandglass_toggled = categories;
+  } else {
+    __atomic_fetch_or(&sandglass_categories, sandglass_toggled,
+                      __ATOMIC_RELAXED);
+  }
+}
+
+int
+sandglass_enable_signal(int signum)
+{
+  struct sigaction action;
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = sandglass_toggle;
+  action.sa_flags   = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  return sigaction(signum, &action, NULL);
+}
+
+/* Read SANDGLASS_ENABLE at startup */
+#ifdef __GNUC__
+__attribute__((constructor))
+#endif
+static void
+sandglass_enable_from_environment(void)
+{
+  const char *value = sandglass_secure_getenv("SANDGLASS_ENABLE");
+  char *end;
+  unsigned long categories;
+
+  if (!value || !*value)
+    return;
+
+  if (strcmp(value, "all") == 0) {
+    categories = SANDGLASS_ALL_CATEGORIES;
+  } else {
+    categories = strtoul(value, &end, 0);
+    if (*end)
+      return;
+  }
+
+  sandglass_enable(categories);
+}
+
+void
+sandglass_zone_record(sandglass_zone_t *zone, long long start)
+{
+  long long ticks = sandglass_ticks_since(start);
+  __atomic_fetch_add(&zone->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&zone->ticks, ticks, __ATOMIC_RELAXED);
+}
+
+void
+sandglass_counter_add(sandglass_counter_t *counter, long n)
+{
+  __atomic_fetch_add(&counter->value, n, __ATOMIC_RELAXED);
+}
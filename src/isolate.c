@@ -0,0 +1,224 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+/* For sched_setaffinity() */
+#define _GNU_SOURCE
+
+#include "sandglass-impl.h"
+#include "sandglass.h"
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+/* Identifies a result message, and its layout */
+#define SANDGLASS_ISOLATE_MAGIC   0x53474c53U /* "SGLS" */
+#define SANDGLASS_ISOLATE_VERSION 1U
+
+/* The message sent from the child to the parent */
+typedef struct sandglass_isolate_message_t
+{
+  unsigned int magic, version;
+
+  /* 0, or an errno value if the child couldn't be set up */
+  int error;
+
+  long grains, total, segments;
+  double freq;
+} sandglass_isolate_message_t;
+
+/* Send a message to the parent, and exit */
+static void
+sandglass_isolate_send(sandglass_isolation_t *isolation,
+                       sandglass_isolate_message_t *message)
+{
+  const char *buf = (const char *)message;
+  size_t left = sizeof(*message);
+  ssize_t written;
+
+  message->magic   = SANDGLASS_ISOLATE_MAGIC;
+  message->version = SANDGLASS_ISOLATE_VERSION;
+
+  while (left > 0) {
+    written = write(isolation->fd, buf, left);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      _exit(EXIT_FAILURE);
+    }
+    buf  += written;
+    left -= written;
+  }
+
+  /* Don't run the parent's atexit() handlers, but don't lose our output */
+  fflush(NULL);
+  _exit(message->error ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/* Apply the pinning and resource limits to the current process */
+static int
+sandglass_isolate_setup(const sandglass_isolation_t *isolation)
+{
+  struct rlimit limit;
+
+  if (isolation->cpu >= 0) {
+#ifdef CPU_SET
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(isolation->cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+      return -1;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+  }
+
+  if (isolation->max_memory > 0) {
+    limit.rlim_cur = limit.rlim_max = isolation->max_memory;
+    if (setrlimit(RLIMIT_AS, &limit) != 0)
+      return -1;
+  }
+
+  if (isolation->max_seconds > 0) {
+    limit.rlim_cur = limit.rlim_max = isolation->max_seconds;
+    if (setrlimit(RLIMIT_CPU, &limit) != 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+int
+sandglass_isolate(sandglass_isolation_t *isolation)
+{
+  sandglass_isolate_message_t message = { .error = 0 };
+  int fds[2];
+  pid_t pid;
+
+  isolation->error  = 0;
+  isolation->status = 0;
+  isolation->pid    = -1;
+  isolation->fd     = -1;
+
+  if (pipe(fds) != 0) {
+    isolation->error = errno;
+    return -1;
+  }
+
+  /* Don't let the child flush our buffered output a second time */
+  fflush(NULL);
+
+  pid = fork();
+  if (pid < 0) {
+    isolation->error = errno;
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  } else if (pid == 0) {
+    /* Child */
+    close(fds[0]);
+    isolation->fd = fds[1];
+    if (sandglass_isolate_setup(isolation) != 0) {
+      message.error = errno;
+      sandglass_isolate_send(isolation, &message);
+    }
+    return 0;
+  }
+
+  /* Parent */
+  close(fds[1]);
+  isolation->pid = pid;
+  isolation->fd  = fds[0];
+  return pid;
+}
+
+void
+sandglass_isolate_report(sandglass_isolation_t *isolation,
+                         const sandglass_t *sandglass)
+{
+  sandglass_isolate_message_t message = { .error = 0 };
+  message.grains   = sandglass->grains;
+  message.total    = sandglass->total;
+  message.segments = sandglass->segments;
+  message.freq     = sandglass->freq;
+  sandglass_isolate_send(isolation, &message);
+}
+
+int
+sandglass_isolate_collect(sandglass_isolation_t *isolation,
+                          sandglass_t *sandglass)
+{
+  sandglass_isolate_message_t message;
+  char *buf = (char *)&message;
+  size_t left = sizeof(message);
+  ssize_t nread;
+
+  if (isolation->pid < 0) {
+    /* sandglass_isolate() failed */
+    errno = isolation->error;
+    return -1;
+  }
+
+  while (left > 0) {
+    nread = read(isolation->fd, buf, left);
+    if (nread < 0 && errno == EINTR)
+      continue;
+    if (nread <= 0)
+      break;
+    buf  += nread;
+    left -= nread;
+  }
+  close(isolation->fd);
+  isolation->fd = -1;
+
+  while (waitpid(isolation->pid, &isolation->status, 0) < 0) {
+    if (errno != EINTR) {
+      isolation->error = errno;
+      break;
+    }
+  }
+  isolation->pid = -1;
+
+  if (left > 0
+      || message.magic != SANDGLASS_ISOLATE_MAGIC
+      || message.version != SANDGLASS_ISOLATE_VERSION) {
+    /* The child crashed, or was killed for exceeding a limit */
+    isolation->error = ECHILD;
+  } else if (message.error) {
+    isolation->error = message.error;
+  } else if (isolation->error == 0) {
+    sandglass->grains   = message.grains;
+    sandglass->total    = message.total;
+    sandglass->segments = message.segments;
+    sandglass->freq     = message.freq;
+  }
+
+  if (isolation->error) {
+    errno = isolation->error;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,196 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "sandglass-lock.h"
+#include "sandglass.h"
+#include <pthread.h>
+#include <errno.h>
+
+/* Add a duration to a total and a histogram */
+static void
+sandglass_lockstat_add(long long *total, long *hist, long long ticks)
+{
+  unsigned long long rest;
+  int bucket = 0;
+
+  for (rest = ticks; rest > 0 && bucket < SANDGLASS_LOCKSTAT_BUCKETS - 1;
+       rest >>= 1) {
+    ++bucket;
+  }
+
+  if (ticks > 0)
+    __atomic_fetch_add(total, ticks, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist[bucket], 1, __ATOMIC_RELAXED);
+}
+
+/* Record an acquisition; begin is when we started waiting, if contended */
+static void
+sandglass_lock_acquired(sandglass_lock_t *lock, sandglass_lockstat_t *stat,
+                        int contended, long long begin)
+{
+  lock->stat     = stat;
+  lock->acquired = sandglass_ticks();
+  lock->wait     = contended
+                   ? sandglass_ticks_between(begin, lock->acquired) : -1;
+  lock->held     = 0;
+  lock->cond     = -1;
+}
+
+/* Stop the hold time clock, before the lock is released */
+static void
+sandglass_lock_releasing(sandglass_lock_t *lock)
+{
+  lock->held += sandglass_ticks_since(lock->acquired);
+}
+
+/* Publish an acquisition's statistics, after the lock is released */
+static void
+sandglass_lock_released(const sandglass_lock_t *lock)
+{
+  sandglass_lockstat_t *stat = lock->stat;
+
+  __atomic_fetch_add(&stat->count, 1, __ATOMIC_RELAXED);
+  if (lock->wait >= 0) {
+    __atomic_fetch_add(&stat->contended, 1, __ATOMIC_RELAXED);
+    sandglass_lockstat_add(&stat->wait_ticks, stat->wait_hist, lock->wait);
+  } else {
+    sandglass_lockstat_add(&stat->wait_ticks, stat->wait_hist, 0);
+  }
+
+  sandglass_lockstat_add(&stat->hold_ticks, stat->hold_hist, lock->held);
+
+  if (lock->cond >= 0)
+    sandglass_lockstat_add(&stat->cond_ticks, stat->cond_hist, lock->cond);
+}
+
+int
+sandglass_mutex_lock(sandglass_lock_t *lock, sandglass_lockstat_t *stat,
+                     pthread_mutex_t *mutex)
+{
+  long long begin;
+  int ret;
+
+  /* Only pay for a second timestamp if we actually have to wait */
+  ret = pthread_mutex_trylock(mutex);
+  if (ret == 0 || ret == EOWNERDEAD) {
+    sandglass_lock_acquired(lock, stat, 0, 0);
+    return ret;
+  } else if (ret != EBUSY) {
+    return ret;
+  }
+
+  begin = sandglass_ticks();
+  ret = pthread_mutex_lock(mutex);
+  if (ret == 0 || ret == EOWNERDEAD)
+    sandglass_lock_acquired(lock, stat, 1, begin);
+  return ret;
+}
+
+int
+sandglass_mutex_unlock(sandglass_lock_t *lock, pthread_mutex_t *mutex)
+{
+  sandglass_lock_t copy;
+  int ret;
+
+  /* The lock may be reused as soon as it's released, so publish a copy */
+  sandglass_lock_releasing(lock);
+  copy = *lock;
+  ret = pthread_mutex_unlock(mutex);
+  sandglass_lock_released(&copy);
+  return ret;
+}
+
+int
+sandglass_rwlock_rdlock(sandglass_lock_t *lock, sandglass_lockstat_t *stat,
+                        pthread_rwlock_t *rwlock)
+{
+  long long begin;
+  int ret;
+
+  ret = pthread_rwlock_tryrdlock(rwlock);
+  if (ret == 0 || ret == EOWNERDEAD) {
+    sandglass_lock_acquired(lock, stat, 0, 0);
+    return ret;
+  } else if (ret != EBUSY) {
+    return ret;
+  }
+
+  begin = sandglass_ticks();
+  ret = pthread_rwlock_rdlock(rwlock);
+  if (ret == 0)
+    sandglass_lock_acquired(lock, stat, 1, begin);
+  return ret;
+}
+
+int
+sandglass_rwlock_wrlock(sandglass_lock_t *lock, sandglass_lockstat_t *stat,
+                        pthread_rwlock_t *rwlock)
+{
+  long long begin;
+  int ret;
+
+  ret = pthread_rwlock_trywrlock(rwlock);
+  if (ret == 0 || ret == EOWNERDEAD) {
+    sandglass_lock_acquired(lock, stat, 0, 0);
+    return ret;
+  } else if (ret != EBUSY) {
+    return ret;
+  }
+
+  begin = sandglass_ticks();
+  ret = pthread_rwlock_wrlock(rwlock);
+  if (ret == 0)
+    sandglass_lock_acquired(lock, stat, 1, begin);
+  return ret;
+}
+
+int
+sandglass_rwlock_unlock(sandglass_lock_t *lock, pthread_rwlock_t *rwlock)
+{
+  sandglass_lock_t copy;
+  int ret;
+
+  /* The lock may be reused as soon as it's released, so publish a copy */
+  sandglass_lock_releasing(lock);
+  copy = *lock;
+  ret = pthread_rwlock_unlock(rwlock);
+  sandglass_lock_released(&copy);
+  return ret;
+}
+
+int
+sandglass_cond_wait(sandglass_lock_t *lock, pthread_cond_t *cond,
+                    pthread_mutex_t *mutex)
+{
+  long long begin;
+  int ret;
+
+  /* The mutex is released while we wait, so pause the hold time clock */
+  begin = sandglass_ticks();
+  lock->held += sandglass_ticks_between(lock->acquired, begin);
+
+  ret = pthread_cond_wait(cond, mutex);
+
+  lock->acquired = sandglass_ticks();
+  if (lock->cond < 0)
+    lock->cond = 0;
+  lock->cond += sandglass_ticks_between(begin, lock->acquired);
+  return ret;
+}
@@ -0,0 +1,112 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "sandglass-impl.h"
+#include "sandglass.h"
+#include <string.h>
+#include <math.h>
+
+/* Windows for the moving averages, in seconds */
+static const double sandglass_meter_windows[3] = { 1.0, 5.0, 15.0 };
+
+/* Next slot to hand out */
+static unsigned int sandglass_meter_next = 0;
+
+/* This thread's slot, plus one so that 0 means unassigned */
+static __thread unsigned int sandglass_meter_thread = 0;
+
+/* Get the slot of the calling thread */
+static unsigned int
+sandglass_meter_slot(void)
+{
+  if (sandglass_meter_thread == 0) {
+    sandglass_meter_thread
+      = __atomic_fetch_add(&sandglass_meter_next, 1, __ATOMIC_RELAXED)
+        % SANDGLASS_METER_SLOTS + 1;
+  }
+  return sandglass_meter_thread - 1;
+}
+
+/* Update a moving average for a sample covering dt seconds */
+static void
+sandglass_ewma_update(double ewma[3], double rate, double dt)
+{
+  int i;
+  for (i = 0; i < 3; ++i) {
+    ewma[i] += (1.0 - exp(-dt/sandglass_meter_windows[i]))*(rate - ewma[i]);
+  }
+}
+
+void
+sandglass_meter_init(sandglass_meter_t *meter)
+{
+  memset(meter, 0, sizeof(*meter));
+}
+
+void
+sandglass_meter_record(sandglass_meter_t *meter, long events, long bytes)
+{
+  sandglass_meter_slot_t *slot = &meter->slots[sandglass_meter_slot()];
+
+  /* Usually uncontended, but threads can share a slot */
+  __atomic_fetch_add(&slot->events, events, __ATOMIC_RELAXED);
+  if (bytes)
+    __atomic_fetch_add(&slot->bytes, bytes, __ATOMIC_RELAXED);
+}
+
+void
+sandglass_meter_update(sandglass_meter_t *meter)
+{
+  long long now, events = 0, bytes = 0;
+  double dt;
+  int i;
+
+  now = sandglass_ticks();
+  for (i = 0; i < SANDGLASS_METER_SLOTS; ++i) {
+    events += __atomic_load_n(&meter->slots[i].events, __ATOMIC_RELAXED);
+    bytes  += __atomic_load_n(&meter->slots[i].bytes, __ATOMIC_RELAXED);
+  }
+
+  if (meter->updated == 0) {
+    /* Nothing to take a rate over yet */
+    meter->updated = now;
+    meter->events  = events;
+    meter->bytes   = bytes;
+    return;
+  }
+
+  dt = (now - meter->updated)/sandglass_ticks_freq();
+  if (dt <= 0.0)
+    return;
+
+  meter->rate      = (events - meter->events)/dt;
+  meter->byte_rate = (bytes - meter->bytes)/dt;
+  sandglass_ewma_update(meter->ewma, meter->rate, dt);
+  sandglass_ewma_update(meter->byte_ewma, meter->byte_rate, dt);
+
+  if (meter->rate > meter->peak)
+    meter->peak = meter->rate;
+  if (meter->byte_rate > meter->byte_peak)
+    meter->byte_peak = meter->byte_rate;
+
+  meter->updated = now;
+  meter->events  = events;
+  meter->bytes   = bytes;
+}
@@ -0,0 +1,103 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+/*
+ * libsandglass coroutine support - C++20 awaiters which pause a sandglass_t
+ * while a coroutine is suspended, so that only its active time is counted.
+ */
+
+#ifndef SANDGLASS_COROUTINE_HPP_INCLUDED
+#define SANDGLASS_COROUTINE_HPP_INCLUDED
+
+#include "sandglass.h"
+#include <coroutine>
+#include <utility>
+
+namespace sandglass
+{
+  namespace detail
+  {
+    // Get the awaiter for an awaitable, the same way co_await does
+    template <typename T>
+    decltype(auto)
+    get_awaiter(T&& awaitable)
+    {
+      if constexpr (requires { std::forward<T>(awaitable).operator co_await(); }) {
+        return std::forward<T>(awaitable).operator co_await();
+      } else if constexpr (requires { operator co_await(std::forward<T>(awaitable)); }) {
+        return operator co_await(std::forward<T>(awaitable));
+      } else {
+        return std::forward<T>(awaitable);
+      }
+    }
+  }
+
+  // Wraps an awaiter, pausing a timer while the coroutine is suspended
+  template <typename Awaiter>
+  class timed_awaiter
+  {
+  public:
+    timed_awaiter(sandglass_t& sandglass, Awaiter&& awaiter)
+      : m_sandglass(sandglass), m_awaiter(std::forward<Awaiter>(awaiter)) { }
+
+    bool await_ready() { return m_awaiter.await_ready(); }
+
+    template <typename Promise>
+    decltype(auto)
+    await_suspend(std::coroutine_handle<Promise> handle)
+    {
+      // Pause before handing off the coroutine, as it may be resumed on
+      // another thread before await_suspend() returns
+      sandglass_pause(&m_sandglass);
+      m_paused = true;
+      return m_awaiter.await_suspend(handle);
+    }
+
+    decltype(auto)
+    await_resume()
+    {
+      if (m_paused) {
+        sandglass_resume(&m_sandglass);
+        m_paused = false;
+      }
+      return m_awaiter.await_resume();
+    }
+
+  private:
+    sandglass_t& m_sandglass;
+    Awaiter m_awaiter;
+    bool m_paused = false;
+  };
+
+  // co_await sandglass::timed(sandglass, awaitable) pauses sandglass for as
+  // long as the coroutine is suspended.  sandglass should have been started
+  // with sandglass_resume().
+  template <typename T>
+  auto
+  timed(sandglass_t& sandglass, T&& awaitable)
+  {
+    using Awaiter = decltype(detail::get_awaiter(std::forward<T>(awaitable)));
+    return timed_awaiter<Awaiter>(
+      sandglass, detail::get_awaiter(std::forward<T>(awaitable))
+    );
+  }
+}
+
+#endif // SANDGLASS_COROUTINE_HPP_INCLUDED
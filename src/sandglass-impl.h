@@ -29,14 +29,46 @@
 #include <time.h>
 
 #if SANDGLASS_TSC
-/* Read the time stamp counter */
-long sandglass_get_tsc();
+/* Read the full 64-bit time stamp counter */
+long long sandglass_get_tsc();
+/* Read the full 64-bit time stamp counter without serializing */
+long long sandglass_get_tsc_unserialized();
 /* Get the frequency of the TSC */
 double sandglass_tsc_freq();
 /* Get the necessary number of loops for sandglass_bench_fine() */
 unsigned int sandglass_tsc_loops();
 #endif
 
+/* Measure (or look up) the overhead of sandglass's clock */
+int sandglass_calibrate(sandglass_t *sandglass);
+
+/* getenv(), but NULL in setuid/setgid programs */
+const char *sandglass_secure_getenv(const char *name);
+
+/* Trace file layout; see sandglass-trace.h */
+#define SANDGLASS_TRACE_MAGIC       "SGTRACE"
+#define SANDGLASS_TRACE_INDEX_MAGIC "SGTRIDX"
+#define SANDGLASS_TRACE_VERSION     1
+#define SANDGLASS_TRACE_HEADER_SIZE 24
+#define SANDGLASS_TRACE_CHUNK_SIZE  32
+#define SANDGLASS_TRACE_ENTRY_SIZE  32
+#define SANDGLASS_TRACE_FOOTER_SIZE 24
+
+/* Chunk kinds */
+#define SANDGLASS_TRACE_RECORDS 0
+#define SANDGLASS_TRACE_ZONES   1
+
+/* Little-endian and varint encoding, returning the new position */
+unsigned char *sandglass_put_u32(unsigned char *p, unsigned long n);
+unsigned char *sandglass_put_u64(unsigned char *p, unsigned long long n);
+unsigned char *sandglass_put_varint(unsigned char *p, unsigned long long n);
+unsigned long sandglass_get_u32(const unsigned char *p);
+unsigned long long sandglass_get_u64(const unsigned char *p);
+/* Returns NULL if the varint runs past end */
+const unsigned char *sandglass_get_varint(const unsigned char *p,
+                                          const unsigned char *end,
+                                          unsigned long long *n);
+
 void sandglass_get_currtime(struct timespec *ts);
 void sandglass_timespec_add(struct timespec *ts, const struct timespec *d);
 void sandglass_timespec_sub(struct timespec *ts, const struct timespec *d);
@@ -0,0 +1,131 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+/*
+ * libsandglass lock profiling - wrappers around the pthread locking primitives
+ * which measure how long each call site waits for and holds its locks.
+ */
+
+#ifndef SANDGLASS_LOCK_H_INCLUDED
+#define SANDGLASS_LOCK_H_INCLUDED
+
+#include "sandglass.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+/* We've been included from a C++ file; mark everything here as extern "C" */
+extern "C" {
+#endif
+
+/* Number of histogram buckets */
+#define SANDGLASS_LOCKSTAT_BUCKETS 48
+
+/*
+ * Lock statistics for one call site.  Durations are in sandglass_ticks() units.
+ * Bucket 0 of each histogram counts zero-tick durations, and bucket i counts
+ * durations in [2^(i-1), 2^i); the last bucket also counts anything longer.
+ */
+typedef struct sandglass_lockstat_t
+{
+  /* A name for the call site */
+  const char *site;
+
+  /* Number of acquisitions, and how many of those had to wait */
+  long count, contended;
+
+  /* Total time spent waiting to acquire the lock, and holding it (not
+     counting condition waits) */
+  long long wait_ticks, hold_ticks;
+
+  /* Total time spent waiting on condition variables while holding the lock;
+     cond_hist counts each acquisition that waited by its total wait */
+  long long cond_ticks;
+
+  long wait_hist[SANDGLASS_LOCKSTAT_BUCKETS];
+  long hold_hist[SANDGLASS_LOCKSTAT_BUCKETS];
+  long cond_hist[SANDGLASS_LOCKSTAT_BUCKETS];
+} sandglass_lockstat_t;
+
+/* Static initializer for a sandglass_lockstat_t */
+#define SANDGLASS_LOCKSTAT_INITIALIZER(site)                                  \
+  { (site), 0, 0, 0, 0, 0, { 0 }, { 0 }, { 0 } }
+
+/* A site name of the form "file.c:42" */
+#define SANDGLASS_LOCKSTAT_HERE SANDGLASS_LOCKSTAT_HERE_(__FILE__, __LINE__)
+#define SANDGLASS_LOCKSTAT_HERE_(file, line) SANDGLASS_LOCKSTAT_HERE__(file, line)
+#define SANDGLASS_LOCKSTAT_HERE__(file, line) file ":" #line
+
+/* The state of one held lock, published to its stat once it's released */
+typedef struct sandglass_lock_t
+{
+  sandglass_lockstat_t *stat;
+
+  /* When we (re-)acquired the lock */
+  long long acquired;
+
+  /* How long we waited to acquire it, or -1 if we didn't */
+  long long wait;
+
+  /* How long we held it before our last condition wait */
+  long long held;
+
+  /* How long we waited on condition variables, or -1 if we didn't */
+  long long cond;
+} sandglass_lock_t;
+
+/*
+ * Lock wrappers.  These return the same values as the pthread functions they
+ * wrap, and may be used like so:
+ *   static sandglass_lockstat_t stat
+ *     = SANDGLASS_LOCKSTAT_INITIALIZER(SANDGLASS_LOCKSTAT_HERE);
+ *   sandglass_lock_t lock;
+ *
+ *   sandglass_mutex_lock(&lock, &stat, &mutex);
+ *   ...
+ *   sandglass_mutex_unlock(&lock, &mutex);
+ *
+ * Statistics are updated atomically, so many threads may share a call site,
+ * and only after the lock is released, so the shared updates don't count
+ * towards the hold time or lengthen the critical section.  Like the pthread
+ * functions, the lock wrappers return EOWNERDEAD with a robust mutex held.
+ */
+int sandglass_mutex_lock(sandglass_lock_t *lock, sandglass_lockstat_t *stat,
+                         pthread_mutex_t *mutex);
+int sandglass_mutex_unlock(sandglass_lock_t *lock, pthread_mutex_t *mutex);
+
+int sandglass_rwlock_rdlock(sandglass_lock_t *lock, sandglass_lockstat_t *stat,
+                            pthread_rwlock_t *rwlock);
+int sandglass_rwlock_wrlock(sandglass_lock_t *lock, sandglass_lockstat_t *stat,
+                            pthread_rwlock_t *rwlock);
+int sandglass_rwlock_unlock(sandglass_lock_t *lock, pthread_rwlock_t *rwlock);
+
+/*
+ * Wait on a condition variable with a mutex locked by sandglass_mutex_lock().
+ * The time spent waiting for the signal is counted separately from the hold
+ * time, and re-acquiring the mutex does not count as an acquisition.
+ */
+int sandglass_cond_wait(sandglass_lock_t *lock, pthread_cond_t *cond,
+                        pthread_mutex_t *mutex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SANDGLASS_LOCK_H_INCLUDED */
@@ -0,0 +1,203 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+/*
+ * libsandglass traces - a compact binary format for recorded intervals, with a
+ * writer that appends per-thread chunks to a file, and a reader that maps the
+ * file into memory and queries it without decoding more than it needs to.
+ *
+ * A trace file holds:
+ *
+ *   A header:  "SGTRACE\0", u32 version, u32 flags (0), f64 tick frequency
+ *   Chunks:    u32 thread, u32 item count, u32 payload size, u32 kind,
+ *              u64 earliest begin, u64 latest end, then the payload.  Record
+ *              chunks (kind 0) hold, for each record, varint zone, zig-zag
+ *              varint begin (relative to the previous record's begin in the
+ *              chunk, or to 0 for the first record), and varint duration.
+ *              Zone chunks (kind 1) are written as zones are registered, with
+ *              thread, begin and end 0, and hold for each zone varint ID,
+ *              varint length and the name.
+ *   Zones:     u32 count, then for each zone, u32 length and the name
+ *   The index: u64 count, then for each record chunk, u64 offset, u32 thread,
+ *              u32 record count, u64 earliest begin, u64 latest end
+ *   A footer:  u64 zones offset, u64 index offset, "SGTRIDX\0"
+ *
+ * All integers are little-endian; varints are unsigned LEB128.  Ticks are in
+ * whatever units the writer recorded, usually sandglass_ticks().
+ */
+
+#ifndef SANDGLASS_TRACE_H_INCLUDED
+#define SANDGLASS_TRACE_H_INCLUDED
+
+#include "sandglass.h"
+#include <pthread.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+/* We've been included from a C++ file; mark everything here as extern "C" */
+extern "C" {
+#endif
+
+/* Size of each thread's buffer, and so the largest chunk payload */
+#define SANDGLASS_TRACE_BUFFER 65536
+
+/* An entry in the chunk index */
+typedef struct sandglass_trace_chunk_t
+{
+  long long offset;
+  unsigned int thread, count;
+  long long first, last;
+} sandglass_trace_chunk_t;
+
+/* A trace being written */
+typedef struct sandglass_trace_t
+{
+  int fd;
+
+  /* Ticks per second */
+  double freq;
+
+  /* Zone names, indexed by zone ID */
+  char **zones;
+  int nzones, zones_capacity;
+
+  /* The chunk index */
+  sandglass_trace_chunk_t *chunks;
+  long nchunks, chunks_capacity;
+
+  /* Current end of the file */
+  long long offset;
+
+  /* Number of threads seen so far */
+  unsigned int nthreads;
+
+  pthread_mutex_t mutex;
+} sandglass_trace_t;
+
+/* One thread's buffer of records not yet written */
+typedef struct sandglass_trace_thread_t
+{
+  sandglass_trace_t *trace;
+  unsigned int thread, count;
+  long long first, last, prev;
+  size_t size;
+  unsigned char buffer[SANDGLASS_TRACE_BUFFER];
+} sandglass_trace_thread_t;
+
+/*
+ * Writing.  sandglass_trace_zone() registers a zone name, writing it to the
+ * file straight away, and returns its ID, or -1 on error; registering the same
+ * name twice gives the same ID.  Each thread records into its own
+ * sandglass_trace_thread_t, which is written to the file as a chunk whenever
+ * it fills up, and by sandglass_trace_thread_flush().  Every thread buffer
+ * must be flushed before sandglass_trace_close().
+ */
+int sandglass_trace_open(sandglass_trace_t *trace, const char *path,
+                         double freq);
+int sandglass_trace_zone(sandglass_trace_t *trace, const char *name);
+int sandglass_trace_close(sandglass_trace_t *trace);
+
+void sandglass_trace_thread_init(sandglass_trace_thread_t *thread,
+                                 sandglass_trace_t *trace);
+int sandglass_trace_record(sandglass_trace_thread_t *thread, int zone,
+                           long long begin, long long end);
+int sandglass_trace_thread_flush(sandglass_trace_thread_t *thread);
+
+/* A trace being read */
+typedef struct sandglass_trace_reader_t
+{
+  /* The mapped file */
+  const unsigned char *map;
+  size_t size;
+
+  /* Ticks per second */
+  double freq;
+
+  /* Zone names, indexed by zone ID */
+  char **zones;
+  int nzones;
+
+  /* The chunk index */
+  const unsigned char *index;
+  long nchunks;
+
+  /* The end of the last chunk */
+  size_t chunks_end;
+
+  /* The index we rebuilt by scanning the chunks, if the file had none */
+  unsigned char *rebuilt;
+} sandglass_trace_reader_t;
+
+/* A decoded record */
+typedef struct sandglass_trace_record_t
+{
+  unsigned int thread;
+  int zone;
+  long long begin, end;
+} sandglass_trace_record_t;
+
+/* Called for each record; return nonzero to stop iterating */
+typedef int sandglass_trace_callback_t(const sandglass_trace_record_t *record,
+                                       void *data);
+
+/* Duration statistics for one zone, in ticks */
+typedef struct sandglass_trace_stats_t
+{
+  long count;
+  long long total, min, max;
+  long long p50, p90, p99;
+} sandglass_trace_stats_t;
+
+/*
+ * Open a trace for reading.  If the writer never got to close it, the index
+ * and zone table are rebuilt by scanning the chunks from the start of the
+ * file, up to the first one that's incomplete; zones whose definitions were
+ * lost are named by their IDs.
+ */
+int sandglass_trace_reader_open(sandglass_trace_reader_t *reader,
+                                const char *path);
+void sandglass_trace_reader_close(sandglass_trace_reader_t *reader);
+
+/*
+ * Queries.  Only records overlapping the tick range [from, to] are considered,
+ * and chunks entirely outside it are skipped without being decoded; pass
+ * LLONG_MIN and LLONG_MAX for the whole trace.  These fail with EINVAL if the
+ * trace is corrupt.
+ */
+int sandglass_trace_foreach(const sandglass_trace_reader_t *reader,
+                            long long from, long long to,
+                            sandglass_trace_callback_t *callback, void *data);
+
+/* Count records and sum durations per zone; the arrays need reader->nzones
+   elements */
+int sandglass_trace_totals(const sandglass_trace_reader_t *reader,
+                           long long from, long long to,
+                           long *counts, long long *totals);
+
+/* Compute duration statistics for a single zone */
+int sandglass_trace_zone_stats(const sandglass_trace_reader_t *reader,
+                               int zone, long long from, long long to,
+                               sandglass_trace_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SANDGLASS_TRACE_H_INCLUDED */
@@ -50,7 +50,9 @@ sandglass_init_introspective(sandglass_t *sandglass, sandglass_resolution_t res)
 
   sandglass->incrementation = SANDGLASS_INTROSPECTIVE;
   sandglass->resolution     = res;
-  return 0;
+  sandglass->total          = 0;
+  sandglass->segments       = 0;
+  return sandglass_calibrate(sandglass);
 }
 
 int
@@ -79,17 +81,20 @@ sandglass_init_monotonic(sandglass_t *sandglass, sandglass_resolution_t res)
 
   sandglass->incrementation = SANDGLASS_MONOTONIC;
   sandglass->resolution     = res;
-  return 0;
+  sandglass->total          = 0;
+  sandglass->segments       = 0;
+  return sandglass_calibrate(sandglass);
 }
 
-/* Store a timer value in sandglass->grains */
-static int sandglass_real_gettime(sandglass_t *sandglass);
+/* Store a timer value in sandglass->grains, and the full time in *full if it's
+   not NULL */
+static int sandglass_real_gettime(sandglass_t *sandglass, long long *full);
 
 /* Start timing */
 int
 sandglass_begin(sandglass_t *sandglass)
 {
-  return sandglass_real_gettime(sandglass);
+  return sandglass_real_gettime(sandglass, NULL);
 }
 
 /* Finish timing */
@@ -98,7 +103,7 @@ sandglass_elapse(sandglass_t *sandglass)
 {
   long oldgrains = sandglass->grains;
 
-  if (sandglass_real_gettime(sandglass))
+  if (sandglass_real_gettime(sandglass, NULL))
     return -1;
 
   sandglass->grains -= oldgrains;
@@ -109,19 +114,48 @@ sandglass_elapse(sandglass_t *sandglass)
   return 0;
 }
 
+/* Start a segment */
+int
+sandglass_resume(sandglass_t *sandglass)
+{
+  return sandglass_real_gettime(sandglass, &sandglass->resumed);
+}
+
+/* Finish a segment */
+int
+sandglass_pause(sandglass_t *sandglass)
+{
+  long long paused;
+
+  /* Unlike sandglass_elapse(), don't lose whole seconds of long segments */
+  if (sandglass_real_gettime(sandglass, &paused) != 0)
+    return -1;
+
+  sandglass->grains = paused - sandglass->resumed;
+  sandglass->total += paused - sandglass->resumed;
+  ++sandglass->segments;
+  return 0;
+}
+
 /* Store a timer value in sandglass->grains */
 static int
-sandglass_real_gettime(sandglass_t *sandglass)
+sandglass_real_gettime(sandglass_t *sandglass, long long *full)
 {
   struct timespec ts;
   clock_t clock_ticks;
+#if SANDGLASS_TSC
+  long long tsc;
+#endif
 
   switch (sandglass->incrementation) {
     case SANDGLASS_MONOTONIC:
       switch (sandglass->resolution) {
         case SANDGLASS_CPUTIME:
 #if SANDGLASS_TSC
-          sandglass->grains = sandglass_get_tsc();
+          tsc = sandglass_get_tsc();
+          sandglass->grains = tsc;
+          if (full)
+            *full = tsc;
           break;
 #else
           errno = ENOTSUP;
@@ -138,6 +172,8 @@ sandglass_real_gettime(sandglass_t *sandglass)
           }
           sandglass->grains     = ts.tv_nsec;
           sandglass->adjustment = 1000000000L;
+          if (full)
+            *full = ts.tv_sec*1000000000LL + ts.tv_nsec;
           break;
 
         default:
@@ -161,6 +197,8 @@ sandglass_real_gettime(sandglass_t *sandglass)
           }
           sandglass->grains     = ts.tv_nsec;
           sandglass->adjustment = 1000000000L;
+          if (full)
+            *full = ts.tv_sec*1000000000LL + ts.tv_nsec;
           break;
 
         case SANDGLASS_SYSTEM:
@@ -168,6 +206,8 @@ sandglass_real_gettime(sandglass_t *sandglass)
           if (clock_ticks == -1)
             return -1;
           sandglass->grains = clock_ticks;
+          if (full)
+            *full = clock_ticks;
           break;
 
         default:
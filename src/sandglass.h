@@ -79,6 +79,11 @@ typedef struct sandglass_t
   /* grains/freq should give elapsed time in seconds */
   double freq;
 
+  /* Units of time accumulated over every sandglass_resume()/_pause() segment,
+     and the number of such segments */
+  long long total;
+  long segments;
+
   /*
    * Internal fields
    */
@@ -89,11 +94,168 @@ typedef struct sandglass_t
   /* For sandglass_bench_fine() looping support */
   int i, loops;
 
-  /* A field used by sandglass_bench() to store the overhead of
-     sandglass_begin()/_elapse(), and of looping */
+  /* The overhead of sandglass_begin()/_elapse(), and of timing an empty
+     sandglass_bench_fine() loop, calibrated once per clock by
+     sandglass_init_*() */
   long baseline;
+  long loop_baseline;
+
+  /* The full time of the last sandglass_resume(); grains only holds the
+     nanoseconds of timespec-based clocks */
+  long long resumed;
 } sandglass_t;
 
+/* A combined wall-clock, CPU time and resource usage measurement */
+typedef struct sandglass_breakdown_t
+{
+  /* Elapsed wall-clock time, and the parts of it spent on and off the CPU, in
+     seconds */
+  double wall, oncpu, offcpu;
+
+  /* Voluntary (blocking) and involuntary (preemption) context switches */
+  long voluntary, involuntary;
+
+  /* Minor and major page faults */
+  long minflt, majflt;
+} sandglass_breakdown_t;
+
+/* Maximum number of reference points kept by a sandglass_tsc_map_t */
+#define SANDGLASS_TSC_MAP_POINTS 64
+
+/* A time stamp counter value paired with the system clocks' readings */
+typedef struct sandglass_tsc_point_t
+{
+  /* The TSC value, taken as the midpoint of the tightest bracket found */
+  long long tsc;
+
+  /* Half the width of that bracket, in ticks */
+  long long error;
+
+  /* CLOCK_MONOTONIC and CLOCK_REALTIME, in nanoseconds */
+  long long monotonic, realtime;
+} sandglass_tsc_point_t;
+
+/*
+ * A piecewise linear mapping from raw time stamp counter values to wall-clock
+ * time.  Reference points are kept in TSC order; when the table fills up, every
+ * other point is dropped, so the whole history stays covered at a coarser
+ * granularity.
+ */
+typedef struct sandglass_tsc_map_t
+{
+  sandglass_tsc_point_t points[SANDGLASS_TSC_MAP_POINTS];
+  int npoints;
+
+  /* Sequence lock: odd while an update is in progress */
+  unsigned long sequence;
+} sandglass_tsc_map_t;
+
+/* Options and results for running a benchmark in a child process */
+typedef struct sandglass_isolation_t
+{
+  /* CPU to pin the child to, or -1 for no pinning */
+  int cpu;
+
+  /* Limits on the child's address space (bytes) and CPU time (seconds), or 0
+     for no limit */
+  long max_memory;
+  long max_seconds;
+
+  /* 0 if the child reported a result, otherwise an errno value; ECHILD means
+     the child died without reporting */
+  int error;
+
+  /* The child's wait() status */
+  int status;
+
+  /*
+   * Internal fields
+   */
+
+  /* Child process ID, and the read (in the parent) or write (in the child) end
+     of the result pipe */
+  int pid, fd;
+} sandglass_isolation_t;
+
+/* Number of per-thread counters in a sandglass_meter_t */
+#define SANDGLASS_METER_SLOTS 64
+
+/* Assumed cache line size, to keep slots from sharing lines */
+#define SANDGLASS_CACHE_LINE 64
+
+/* Event counters for one thread (or a few, if there are more threads than
+   slots) */
+typedef struct sandglass_meter_slot_t
+{
+  long long events, bytes;
+  char padding[SANDGLASS_CACHE_LINE - 2*sizeof(long long)];
+}
+#ifdef __GNUC__
+__attribute__((aligned(SANDGLASS_CACHE_LINE)))
+#endif
+sandglass_meter_slot_t;
+
+/* A throughput meter */
+typedef struct sandglass_meter_t
+{
+  /* Events and bytes recorded so far */
+  long long events, bytes;
+
+  /* Rates over the last sandglass_meter_update() interval, per second */
+  double rate, byte_rate;
+
+  /* Exponentially weighted moving averages of the rates, over 1, 5 and 15
+     seconds */
+  double ewma[3], byte_ewma[3];
+
+  /* Highest rates seen by sandglass_meter_update() */
+  double peak, byte_peak;
+
+  /*
+   * Internal fields
+   */
+
+  /* Time of the last update, or 0 before the first one */
+  long long updated;
+
+  sandglass_meter_slot_t slots[SANDGLASS_METER_SLOTS];
+} sandglass_meter_t;
+
+/* An instrumented region of code */
+typedef struct sandglass_zone_t
+{
+  const char *name;
+
+  /* The categories which enable this zone */
+  unsigned long category;
+
+  /* Number of times the zone was entered while enabled, and the total
+     sandglass_ticks() spent inside it */
+  long count;
+  long long ticks;
+} sandglass_zone_t;
+
+/* An instrumentation counter */
+typedef struct sandglass_counter_t
+{
+  const char *name;
+  unsigned long category;
+  long value;
+} sandglass_counter_t;
+
+/* Static initializers for zones and counters */
+#define SANDGLASS_ZONE_INITIALIZER(name, category)                            \
+  { (name), (category), 0, 0 }
+#define SANDGLASS_COUNTER_INITIALIZER(name, category)                         \
+  { (name), (category), 0 }
+
+/* The state of a SANDGLASS_SCOPE() */
+typedef struct sandglass_scope_t
+{
+  sandglass_zone_t *zone;
+  long long start;
+} sandglass_scope_t;
+
 /* Create a timer */
 int sandglass_init_introspective(sandglass_t *sandglass,
                                  sandglass_resolution_t res);
@@ -103,6 +265,148 @@ int sandglass_init_monotonic(sandglass_t *sandglass,
 int sandglass_begin(sandglass_t *sandglass);
 int sandglass_elapse(sandglass_t *sandglass);
 
+/*
+ * Accumulate time over several segments.  sandglass_resume() starts a segment
+ * and sandglass_pause() ends it, adding its length to sandglass->total.  A
+ * segment must start and end on the same thread, but different segments may
+ * run on different threads, e.g. as an asynchronous task migrates between
+ * workers.  The sandglass_init_*() functions reset the total.
+ */
+int sandglass_resume(sandglass_t *sandglass);
+int sandglass_pause(sandglass_t *sandglass);
+
+/*
+ * Sample wall-clock time, the calling thread's CPU time, and its resource
+ * usage together.  After sandglass_breakdown_elapse(), offcpu tells how long
+ * the thread spent blocked (on I/O, locks, etc.) or waiting to be scheduled.
+ * Both calls must be made from the same thread.
+ */
+int sandglass_breakdown_begin(sandglass_breakdown_t *breakdown);
+int sandglass_breakdown_elapse(sandglass_breakdown_t *breakdown);
+
+/*
+ * Correlate the time stamp counter with CLOCK_MONOTONIC and CLOCK_REALTIME.
+ * sandglass_tsc_map_init() takes the first reference point;
+ * sandglass_tsc_map_update() should be called periodically (e.g. once a
+ * second) to track drift.  Updates are published with a sequence lock, so
+ * conversions may run concurrently with an update from any thread, and never
+ * block it.  Every function fails with ENOTSUP if there is no TSC.
+ */
+int sandglass_tsc_map_init(sandglass_tsc_map_t *map);
+int sandglass_tsc_map_update(sandglass_tsc_map_t *map);
+
+/* Convert a raw TSC value to nanoseconds on the given clock */
+int sandglass_tsc_to_monotonic(const sandglass_tsc_map_t *map,
+                               long long tsc, long long *ns);
+int sandglass_tsc_to_realtime(const sandglass_tsc_map_t *map,
+                              long long tsc, long long *ns);
+
+/*
+ * A cheap timestamp for instrumentation: the unserialized TSC if available, or
+ * CLOCK_MONOTONIC otherwise.  sandglass_ticks_freq() gives ticks per second.
+ * Ticks are 64 bits wide even on 32-bit platforms, so they don't wrap.
+ * sandglass_ticks_between() and _since() give elapsed ticks, never negative,
+ * even when the two timestamps came from different CPUs.
+ */
+long long sandglass_ticks(void);
+long long sandglass_ticks_between(long long begin, long long end);
+long long sandglass_ticks_since(long long start);
+double sandglass_ticks_freq(void);
+
+/*
+ * Run a benchmark in a forked child process.  sandglass_isolate() returns 0 in
+ * the child, which should run the benchmark and call sandglass_isolate_report()
+ * to send the result to the parent and exit.  In the parent,
+ * sandglass_isolate_collect() waits for the child and copies its result into
+ * sandglass.  sandglass_bench_isolated() below wraps all three.
+ */
+int sandglass_isolate(sandglass_isolation_t *isolation);
+void sandglass_isolate_report(sandglass_isolation_t *isolation,
+                              const sandglass_t *sandglass);
+int sandglass_isolate_collect(sandglass_isolation_t *isolation,
+                              sandglass_t *sandglass);
+
+/*
+ * Measure throughput.  sandglass_meter_record() may be called from any number
+ * of threads, and never blocks; each thread adds to its own slot.
+ * sandglass_meter_update() sums the slots and updates the rates, and should be
+ * called periodically (e.g. once a second) from a single thread.
+ */
+void sandglass_meter_init(sandglass_meter_t *meter);
+void sandglass_meter_record(sandglass_meter_t *meter, long events, long bytes);
+void sandglass_meter_update(sandglass_meter_t *meter);
+
+/*
+ * Runtime-toggleable instrumentation.  Every zone and counter belongs to a set
+ * of categories (bits), and only does anything while one of them is enabled;
+ * otherwise, it costs a load and a predictable branch.  Categories can be
+ * enabled with sandglass_enable(), by setting the SANDGLASS_ENABLE environment
+ * variable to a mask (or "all") at startup, or by sending a signal registered
+ * with sandglass_enable_signal(), which toggles everything on and off.
+ */
+extern volatile unsigned long sandglass_categories;
+
+#define SANDGLASS_ALL_CATEGORIES (~0UL)
+
+void sandglass_enable(unsigned long categories);
+void sandglass_disable(unsigned long categories);
+int sandglass_enable_signal(int signum);
+
+#ifdef __GNUC__
+  #define SANDGLASS_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+  #define SANDGLASS_UNLIKELY(x) (x)
+#endif
+
+#define SANDGLASS_ENABLED(category)                                            \
+  SANDGLASS_UNLIKELY(sandglass_categories & (category))
+
+/* Slow paths for the macros below */
+void sandglass_zone_record(sandglass_zone_t *zone, long long start);
+void sandglass_counter_add(sandglass_counter_t *counter, long n);
+
+/*
+ * Time a zone like so:
+ *   long long start = sandglass_zone_enter(&zone);
+ *   ...
+ *   sandglass_zone_leave(&zone, start);
+ * start is 0 if the zone was disabled on entry, so toggling categories while
+ * inside a zone is safe.
+ */
+#define sandglass_zone_enter(zone)                                             \
+  (SANDGLASS_ENABLED((zone)->category) ? sandglass_ticks() : 0LL)
+
+#define sandglass_zone_leave(zone, start)                                      \
+  do {                                                                         \
+    if (SANDGLASS_UNLIKELY((start) != 0))                                      \
+      sandglass_zone_record(zone, start);                                      \
+  } while (0)
+
+/* Add n to a counter */
+#define sandglass_count(counter, n)                                            \
+  do {                                                                         \
+    if (SANDGLASS_ENABLED((counter)->category))                                \
+      sandglass_counter_add(counter, n);                                       \
+  } while (0)
+
+static inline void
+sandglass_scope_leave(sandglass_scope_t *scope)
+{
+  sandglass_zone_leave(scope->zone, scope->start);
+}
+
+#ifdef __GNUC__
+/* Time a zone until the end of the enclosing block */
+#define SANDGLASS_SCOPE(zone)                                                  \
+  SANDGLASS_SCOPE_(zone, __LINE__)
+#define SANDGLASS_SCOPE_(zone, line)                                           \
+  SANDGLASS_SCOPE__(zone, line)
+#define SANDGLASS_SCOPE__(zone, line)                                          \
+  sandglass_scope_t sandglass_scope_##line                                     \
+    __attribute__((cleanup(sandglass_scope_leave)))                            \
+    = { (zone), sandglass_zone_enter(zone) }
+#endif
+
 /* Use this to prevent a loop from being unrolled */
 #define SANDGLASS_NO_UNROLL() __asm__ __volatile__ ("")
 
@@ -117,24 +421,27 @@ int sandglass_elapse(sandglass_t *sandglass);
  *   });
  */
 
+/*
+ * The overhead subtracted by these macros is measured when the timer is
+ * initialized.  Set the SANDGLASS_CALIBRATION_FILE environment variable to a
+ * path to keep the measurements across runs; they're discarded if the CPU model
+ * or boot ID changes.
+ */
+
+/* Subtract the calibrated overhead, without letting grains go negative */
+#define SANDGLASS_SUBTRACT_BASELINE(sandglass, baseline)                       \
+  do {                                                                         \
+    (sandglass)->grains -= (baseline);                                         \
+    if ((sandglass)->grains < 0)                                               \
+      (sandglass)->grains = 0;                                                 \
+  } while (0)
+
 /* Provides single clock cycle resolution in some cases */
 #define sandglass_bench_fine(sandglass, routine)                               \
   do {                                                                         \
     /* Warm up the cache for these functions */                                \
     sandglass_begin(sandglass);                                                \
     sandglass_elapse(sandglass);                                               \
-    sandglass_begin(sandglass);                                                \
-    sandglass_elapse(sandglass);                                               \
-                                                                               \
-    /* Time an empty loop for our baseline */                                  \
-    sandglass_begin(sandglass);                                                \
-    for ((sandglass)->i = 0;                                                   \
-         (sandglass)->i < (sandglass)->loops;                                  \
-         ++(sandglass)->i) {                                                   \
-      SANDGLASS_NO_UNROLL();                                                   \
-    }                                                                          \
-    sandglass_elapse(sandglass);                                               \
-    (sandglass)->baseline = (sandglass)->grains;                               \
                                                                                \
     /* Warm up the cache for our routine */                                    \
     routine;                                                                   \
@@ -152,7 +459,7 @@ int sandglass_elapse(sandglass_t *sandglass);
     sandglass_elapse(sandglass);                                               \
                                                                                \
     /* Subtract the baseline and divide by the loop count */                   \
-    (sandglass)->grains -= (sandglass)->baseline;                              \
+    SANDGLASS_SUBTRACT_BASELINE(sandglass, (sandglass)->loop_baseline);        \
     (sandglass)->grains /= (sandglass)->loops;                                 \
   } while (0)
 
@@ -162,13 +469,6 @@ int sandglass_elapse(sandglass_t *sandglass);
     /* Warm up the cache for these functions */                                \
     sandglass_begin(sandglass);                                                \
     sandglass_elapse(sandglass);                                               \
-    sandglass_begin(sandglass);                                                \
-    sandglass_elapse(sandglass);                                               \
-                                                                               \
-    /* Time an empty routine for our baseline */                               \
-    sandglass_begin(sandglass);                                                \
-    sandglass_elapse(sandglass);                                               \
-    (sandglass)->baseline = (sandglass)->grains;                               \
                                                                                \
     /* Warm up the cache for our routine */                                    \
     routine;                                                                   \
@@ -180,7 +480,7 @@ int sandglass_elapse(sandglass_t *sandglass);
     sandglass_elapse(sandglass);                                               \
                                                                                \
     /* Subtract the baseline */                                                \
-    (sandglass)->grains -= (sandglass)->baseline;                              \
+    SANDGLASS_SUBTRACT_BASELINE(sandglass, (sandglass)->baseline);             \
   } while (0)
 
 /* Only executes routine once - useful if routine has side-effects */
@@ -188,22 +488,31 @@ int sandglass_elapse(sandglass_t *sandglass);
   do {                                                                         \
     /* Warm up the cache for these functions */                                \
     sandglass_begin(sandglass);                                                \
-    sandglass_elapse(sandglass);                                               \
-    sandglass_begin(sandglass);                                                \
     sandglass_elapse(sandglass);                                               \
                                                                                \
-    /* Time an empty loop for our baseline */                                  \
-    sandglass_begin(sandglass);                                                \
-    sandglass_elapse(sandglass);                                               \
-    (sandglass)->baseline = (sandglass)->grains;                               \
-                                                                               \
     /* Time the routine */                                                     \
     sandglass_begin(sandglass);                                                \
     routine;                                                                   \
     sandglass_elapse(sandglass);                                               \
                                                                                \
     /* Subtract the baseline */                                                \
-    (sandglass)->grains -= (sandglass)->baseline;                              \
+    SANDGLASS_SUBTRACT_BASELINE(sandglass, (sandglass)->baseline);             \
+  } while (0)
+
+/*
+ * Run one of the above macros in a child process, so that a crash can't take
+ * down the caller, and benchmarks can't disturb each other's heap.  Called like
+ * so:
+ *   sandglass_bench_isolated(&sandglass, &isolation, sandglass_bench, f(x));
+ * Check isolation.error afterwards.
+ */
+#define sandglass_bench_isolated(sandglass, isolation, bench, routine)         \
+  do {                                                                         \
+    if (sandglass_isolate(isolation) == 0) {                                   \
+      bench(sandglass, routine);                                               \
+      sandglass_isolate_report(isolation, sandglass);                          \
+    }                                                                          \
+    sandglass_isolate_collect(isolation, sandglass);                           \
   } while (0)
 
 #ifdef __cplusplus
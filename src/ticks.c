@@ -0,0 +1,61 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "sandglass-impl.h"
+#include "sandglass.h"
+#include <time.h>
+
+long long
+sandglass_ticks(void)
+{
+#if SANDGLASS_TSC
+  return sandglass_get_tsc_unserialized();
+#else
+  struct timespec ts;
+  sandglass_get_currtime(&ts);
+  return ts.tv_sec*1000000000LL + ts.tv_nsec;
+#endif
+}
+
+long long
+sandglass_ticks_between(long long begin, long long end)
+{
+  if (end < begin) {
+    /* The TSCs of different CPUs can disagree slightly */
+    return 0;
+  }
+  return end - begin;
+}
+
+long long
+sandglass_ticks_since(long long start)
+{
+  return sandglass_ticks_between(start, sandglass_ticks());
+}
+
+double
+sandglass_ticks_freq(void)
+{
+#if SANDGLASS_TSC
+  return sandglass_tsc_freq();
+#else
+  return 1e9;
+#endif
+}
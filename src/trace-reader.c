@@ -0,0 +1,527 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "sandglass-trace.h"
+#include "sandglass-impl.h"
+#include "sandglass.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+/* Read the zone table */
+static int
+sandglass_trace_read_zones(sandglass_trace_reader_t *reader,
+                           const unsigned char *p, const unsigned char *end)
+{
+  unsigned long count, len, i;
+
+  if (end - p < 4)
+    return -1;
+  count = sandglass_get_u32(p);
+  p += 4;
+  if (count > (unsigned long)(end - p)/4)
+    return -1;
+
+  reader->zones = calloc(count ? count : 1, sizeof(char *));
+  if (!reader->zones)
+    return -1;
+
+  for (i = 0; i < count; ++i) {
+    if (end - p < 4)
+      return -1;
+    len = sandglass_get_u32(p);
+    p += 4;
+    if ((unsigned long)(end - p) < len)
+      return -1;
+
+    reader->zones[i] = malloc(len + 1);
+    if (!reader->zones[i])
+      return -1;
+    memcpy(reader->zones[i], p, len);
+    reader->zones[i][len] = '\0';
+    p += len;
+    ++reader->nzones;
+  }
+
+  return 0;
+}
+
+/* Check that a chunk's payload decodes, and find the highest zone it uses */
+static int
+sandglass_trace_chunk_check(const unsigned char *p, const unsigned char *end,
+                            unsigned long count, unsigned long long *maxzone)
+{
+  unsigned long long zone, value;
+  unsigned long i;
+
+  for (i = 0; i < count; ++i) {
+    p = sandglass_get_varint(p, end, &zone);
+    if (p)
+      p = sandglass_get_varint(p, end, &value);
+    if (p)
+      p = sandglass_get_varint(p, end, &value);
+    if (!p)
+      return -1;
+
+    if (zone > *maxzone)
+      *maxzone = zone;
+  }
+
+  /* The writer fills the payload exactly */
+  return p == end ? 0 : -1;
+}
+
+/* Add the names from a zone definition chunk to reader->zones */
+static int
+sandglass_trace_recover_zones(sandglass_trace_reader_t *reader,
+                              const unsigned char *p, const unsigned char *end,
+                              unsigned long count)
+{
+  unsigned long long zone, len;
+  unsigned long i;
+  char **zones;
+
+  for (i = 0; i < count; ++i) {
+    p = sandglass_get_varint(p, end, &zone);
+    if (p)
+      p = sandglass_get_varint(p, end, &len);
+
+    /* The writer defines zones in order, so anything else is garbage */
+    if (!p || zone != (unsigned long long)reader->nzones
+        || len > (unsigned long long)(end - p) || reader->nzones == INT_MAX)
+      return -1;
+
+    zones = realloc(reader->zones, (reader->nzones + 1)*sizeof(char *));
+    if (!zones)
+      return -1;
+    reader->zones = zones;
+
+    reader->zones[reader->nzones] = malloc(len + 1);
+    if (!reader->zones[reader->nzones])
+      return -1;
+    memcpy(reader->zones[reader->nzones], p, len);
+    reader->zones[reader->nzones][len] = '\0';
+    ++reader->nzones;
+    p += len;
+  }
+
+  return p == end ? 0 : -1;
+}
+
+/* Rebuild the index and zone table of a trace that was never closed */
+static int
+sandglass_trace_recover(sandglass_trace_reader_t *reader)
+{
+  size_t offset = SANDGLASS_TRACE_HEADER_SIZE;
+  unsigned long long maxzone = 0;
+  unsigned long count, size, kind;
+  const unsigned char *chunk, *payload;
+  unsigned char *index, *entry;
+  long capacity = 0;
+  char **zones, name[32];
+  int nzones = 0;
+
+  /* Stop at the first chunk that's cut off or doesn't decode */
+  while (reader->size - offset >= SANDGLASS_TRACE_CHUNK_SIZE) {
+    chunk   = reader->map + offset;
+    payload = chunk + SANDGLASS_TRACE_CHUNK_SIZE;
+    count   = sandglass_get_u32(chunk + 4);
+    size    = sandglass_get_u32(chunk + 8);
+    kind    = sandglass_get_u32(chunk + 12);
+    if (size > reader->size - offset - SANDGLASS_TRACE_CHUNK_SIZE)
+      break;
+
+    if (kind == SANDGLASS_TRACE_ZONES) {
+      if (sandglass_trace_recover_zones(reader, payload, payload + size,
+                                        count) != 0)
+        break;
+      offset += SANDGLASS_TRACE_CHUNK_SIZE + size;
+      continue;
+    }
+
+    if (kind != SANDGLASS_TRACE_RECORDS
+        || sandglass_trace_chunk_check(payload, payload + size,
+                                       count, &maxzone) != 0)
+      break;
+    if (count > 0 && maxzone >= (unsigned long long)nzones) {
+      if (maxzone >= INT_MAX)
+        break;
+      nzones = maxzone + 1;
+    }
+
+    if (reader->nchunks == capacity) {
+      capacity = capacity ? 2*capacity : 64;
+      index = realloc(reader->rebuilt, capacity*SANDGLASS_TRACE_ENTRY_SIZE);
+      if (!index)
+        return -1;
+      reader->rebuilt = index;
+    }
+
+    /* Same layout as a written index entry */
+    entry = reader->rebuilt + reader->nchunks*SANDGLASS_TRACE_ENTRY_SIZE;
+    entry = sandglass_put_u64(entry, offset);
+    memcpy(entry, chunk, 8);
+    memcpy(entry + 8, chunk + 16, 16);
+    ++reader->nchunks;
+
+    offset += SANDGLASS_TRACE_CHUNK_SIZE + size;
+  }
+
+  reader->index      = reader->rebuilt;
+  reader->chunks_end = offset;
+
+  /* Name any zones whose definitions were lost by their IDs */
+  zones = realloc(reader->zones,
+                  (nzones > reader->nzones ? nzones : reader->nzones + 1)
+                  *sizeof(char *));
+  if (!zones)
+    return -1;
+  reader->zones = zones;
+  while (reader->nzones < nzones) {
+    snprintf(name, sizeof(name), "%d", reader->nzones);
+    reader->zones[reader->nzones] = malloc(strlen(name) + 1);
+    if (!reader->zones[reader->nzones])
+      return -1;
+    strcpy(reader->zones[reader->nzones], name);
+    ++reader->nzones;
+  }
+
+  return 0;
+}
+
+int
+sandglass_trace_reader_open(sandglass_trace_reader_t *reader,
+                            const char *path)
+{
+  const unsigned char *footer;
+  unsigned long long zones_offset, index_offset, limit;
+  union { double d; unsigned long long u; } bits;
+  struct stat st;
+  void *map;
+  int fd;
+
+  memset(reader, 0, sizeof(*reader));
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  if (st.st_size < SANDGLASS_TRACE_HEADER_SIZE) {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return -1;
+
+  reader->map  = map;
+  reader->size = st.st_size;
+
+  /* Check the header */
+  if (memcmp(reader->map, SANDGLASS_TRACE_MAGIC, 8) != 0
+      || sandglass_get_u32(reader->map + 8) != SANDGLASS_TRACE_VERSION)
+    goto corrupt;
+
+  bits.u = sandglass_get_u64(reader->map + 16);
+  reader->freq = bits.d;
+
+  /* Without a footer, the writer didn't finish; salvage what it wrote */
+  if (reader->size
+        < SANDGLASS_TRACE_HEADER_SIZE + SANDGLASS_TRACE_FOOTER_SIZE
+      || memcmp(reader->map + reader->size - 8, SANDGLASS_TRACE_INDEX_MAGIC, 8)
+         != 0) {
+    if (sandglass_trace_recover(reader) != 0) {
+      sandglass_trace_reader_close(reader);
+      return -1;
+    }
+    return 0;
+  }
+  footer = reader->map + reader->size - SANDGLASS_TRACE_FOOTER_SIZE;
+
+  /* Written without additions, so garbage offsets can't wrap around */
+  zones_offset = sandglass_get_u64(footer);
+  index_offset = sandglass_get_u64(footer + 8);
+  limit        = footer - reader->map;
+  if (zones_offset < SANDGLASS_TRACE_HEADER_SIZE
+      || zones_offset > index_offset
+      || index_offset > limit || limit - index_offset < 8)
+    goto corrupt;
+  reader->chunks_end = zones_offset;
+
+  if (sandglass_trace_read_zones(reader, reader->map + zones_offset,
+                                 reader->map + index_offset) != 0)
+    goto corrupt;
+
+  reader->nchunks = sandglass_get_u64(reader->map + index_offset);
+  reader->index   = reader->map + index_offset + 8;
+  if ((unsigned long long)reader->nchunks
+      > (unsigned long long)(footer - reader->index)/SANDGLASS_TRACE_ENTRY_SIZE)
+    goto corrupt;
+  return 0;
+
+ corrupt:
+  sandglass_trace_reader_close(reader);
+  errno = EINVAL;
+  return -1;
+}
+
+void
+sandglass_trace_reader_close(sandglass_trace_reader_t *reader)
+{
+  int i;
+
+  free(reader->rebuilt);
+
+  if (reader->zones) {
+    for (i = 0; i < reader->nzones; ++i) {
+      free(reader->zones[i]);
+    }
+    free(reader->zones);
+  }
+
+  if (reader->map)
+    munmap((void *)reader->map, reader->size);
+
+  memset(reader, 0, sizeof(*reader));
+}
+
+/* Decode the records of one chunk */
+static int
+sandglass_trace_chunk_foreach(const sandglass_trace_reader_t *reader,
+                              const unsigned char *entry,
+                              long long from, long long to,
+                              sandglass_trace_callback_t *callback, void *data)
+{
+  sandglass_trace_record_t record;
+  unsigned long long offset, zone, zigzag, duration;
+  const unsigned char *p, *end;
+  unsigned long count, size, i;
+  long long prev;
+
+  /* Chunks must lie between the header and the zone table */
+  offset = sandglass_get_u64(entry);
+  if (offset < SANDGLASS_TRACE_HEADER_SIZE || offset > reader->chunks_end
+      || reader->chunks_end - offset < SANDGLASS_TRACE_CHUNK_SIZE)
+    goto corrupt;
+
+  p = reader->map + offset;
+  record.thread = sandglass_get_u32(p);
+  count = sandglass_get_u32(p + 4);
+  size  = sandglass_get_u32(p + 8);
+  prev  = 0;
+  p += SANDGLASS_TRACE_CHUNK_SIZE;
+  if (size > reader->chunks_end - offset - SANDGLASS_TRACE_CHUNK_SIZE)
+    goto corrupt;
+  end = p + size;
+
+  for (i = 0; i < count; ++i) {
+    p = sandglass_get_varint(p, end, &zone);
+    if (p)
+      p = sandglass_get_varint(p, end, &zigzag);
+    if (p)
+      p = sandglass_get_varint(p, end, &duration);
+    if (!p || zone >= (unsigned long long)reader->nzones)
+      goto corrupt;
+
+    record.zone  = zone;
+    record.begin = prev + (long long)((zigzag >> 1) ^ -(zigzag & 1));
+    record.end   = record.begin + (long long)duration;
+    prev = record.begin;
+
+    if (record.end >= from && record.begin <= to) {
+      if (callback(&record, data))
+        return 1;
+    }
+  }
+
+  return 0;
+
+ corrupt:
+  errno = EINVAL;
+  return -1;
+}
+
+int
+sandglass_trace_foreach(const sandglass_trace_reader_t *reader,
+                        long long from, long long to,
+                        sandglass_trace_callback_t *callback, void *data)
+{
+  const unsigned char *entry;
+  long long first, last;
+  long i;
+  int ret;
+
+  for (i = 0; i < reader->nchunks; ++i) {
+    entry = reader->index + i*SANDGLASS_TRACE_ENTRY_SIZE;
+
+    /* Skip chunks outside the range without touching them */
+    first = (long long)sandglass_get_u64(entry + 16);
+    last  = (long long)sandglass_get_u64(entry + 24);
+    if (last < from || first > to)
+      continue;
+
+    ret = sandglass_trace_chunk_foreach(reader, entry, from, to,
+                                        callback, data);
+    if (ret < 0)
+      return -1;
+    else if (ret > 0)
+      break;
+  }
+
+  return 0;
+}
+
+/* State for sandglass_trace_totals() */
+typedef struct sandglass_trace_totals_t
+{
+  long *counts;
+  long long *totals;
+} sandglass_trace_totals_t;
+
+static int
+sandglass_trace_totals_callback(const sandglass_trace_record_t *record,
+                                void *data)
+{
+  sandglass_trace_totals_t *totals = data;
+  ++totals->counts[record->zone];
+  totals->totals[record->zone] += record->end - record->begin;
+  return 0;
+}
+
+int
+sandglass_trace_totals(const sandglass_trace_reader_t *reader,
+                       long long from, long long to,
+                       long *counts, long long *totals)
+{
+  sandglass_trace_totals_t data = { counts, totals };
+  memset(counts, 0, reader->nzones*sizeof(long));
+  memset(totals, 0, reader->nzones*sizeof(long long));
+  return sandglass_trace_foreach(reader, from, to,
+                                 sandglass_trace_totals_callback, &data);
+}
+
+/* State for sandglass_trace_zone_stats() */
+typedef struct sandglass_trace_durations_t
+{
+  int zone, error;
+  long long *durations;
+  size_t size, capacity;
+} sandglass_trace_durations_t;
+
+static int
+sandglass_trace_durations_callback(const sandglass_trace_record_t *record,
+                                   void *data)
+{
+  sandglass_trace_durations_t *durations = data;
+  long long *array;
+
+  if (record->zone != durations->zone)
+    return 0;
+
+  if (durations->size == durations->capacity) {
+    durations->capacity = durations->capacity ? 2*durations->capacity : 1024;
+    array = realloc(durations->durations,
+                    durations->capacity*sizeof(long long));
+    if (!array) {
+      durations->error = errno;
+      return 1;
+    }
+    durations->durations = array;
+  }
+
+  durations->durations[durations->size++] = record->end - record->begin;
+  return 0;
+}
+
+static int
+sandglass_compare_long_longs(const void *a, const void *b)
+{
+  long long x = *(const long long *)a, y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of a sorted array */
+static long long
+sandglass_percentile(const long long *sorted, size_t size, int percent)
+{
+  size_t rank = (size*percent + 99)/100;
+  return sorted[rank ? rank - 1 : 0];
+}
+
+int
+sandglass_trace_zone_stats(const sandglass_trace_reader_t *reader,
+                           int zone, long long from, long long to,
+                           sandglass_trace_stats_t *stats)
+{
+  sandglass_trace_durations_t durations = { zone, 0, NULL, 0, 0 };
+  size_t i;
+
+  memset(stats, 0, sizeof(*stats));
+
+  if (zone < 0 || zone >= reader->nzones) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (sandglass_trace_foreach(reader, from, to,
+                              sandglass_trace_durations_callback,
+                              &durations) != 0) {
+    free(durations.durations);
+    return -1;
+  }
+  if (durations.error) {
+    free(durations.durations);
+    errno = durations.error;
+    return -1;
+  }
+
+  if (durations.size > 0) {
+    qsort(durations.durations, durations.size, sizeof(long long),
+          sandglass_compare_long_longs);
+
+    stats->count = durations.size;
+    for (i = 0; i < durations.size; ++i) {
+      stats->total += durations.durations[i];
+    }
+    stats->min = durations.durations[0];
+    stats->max = durations.durations[durations.size - 1];
+    stats->p50 = sandglass_percentile(durations.durations, durations.size, 50);
+    stats->p90 = sandglass_percentile(durations.durations, durations.size, 90);
+    stats->p99 = sandglass_percentile(durations.durations, durations.size, 99);
+  }
+
+  free(durations.durations);
+  return 0;
+}
@@ -0,0 +1,443 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "sandglass-trace.h"
+#include "sandglass-impl.h"
+#include "sandglass.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* The most bytes a single varint can take */
+#define SANDGLASS_TRACE_VARINT_MAX 10
+
+/* The most bytes a single encoded record can take */
+#define SANDGLASS_TRACE_RECORD_MAX (3*SANDGLASS_TRACE_VARINT_MAX)
+
+unsigned char *
+sandglass_put_u32(unsigned char *p, unsigned long n)
+{
+  int i;
+  for (i = 0; i < 4; ++i) {
+    *p++ = (n >> 8*i) & 0xFF;
+  }
+  return p;
+}
+
+unsigned char *
+sandglass_put_u64(unsigned char *p, unsigned long long n)
+{
+  int i;
+  for (i = 0; i < 8; ++i) {
+    *p++ = (n >> 8*i) & 0xFF;
+  }
+  return p;
+}
+
+unsigned char *
+sandglass_put_varint(unsigned char *p, unsigned long long n)
+{
+  while (n >= 0x80) {
+    *p++ = (n & 0x7F) | 0x80;
+    n >>= 7;
+  }
+  *p++ = n;
+  return p;
+}
+
+unsigned long
+sandglass_get_u32(const unsigned char *p)
+{
+  unsigned long n = 0;
+  int i;
+  for (i = 0; i < 4; ++i) {
+    n |= (unsigned long)p[i] << 8*i;
+  }
+  return n;
+}
+
+unsigned long long
+sandglass_get_u64(const unsigned char *p)
+{
+  unsigned long long n = 0;
+  int i;
+  for (i = 0; i < 8; ++i) {
+    n |= (unsigned long long)p[i] << 8*i;
+  }
+  return n;
+}
+
+const unsigned char *
+sandglass_get_varint(const unsigned char *p, const unsigned char *end,
+                     unsigned long long *n)
+{
+  int shift = 0;
+
+  *n = 0;
+  while (p < end && shift < 64) {
+    *n |= (unsigned long long)(*p & 0x7F) << shift;
+    if (!(*p++ & 0x80))
+      return p;
+    shift += 7;
+  }
+  return NULL;
+}
+
+/* Write all of buf, at the end of the file */
+static int
+sandglass_trace_write(sandglass_trace_t *trace, const void *buf, size_t size)
+{
+  const char *p = buf;
+  ssize_t written;
+
+  while (size > 0) {
+    written = write(trace->fd, p, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p    += written;
+    size -= written;
+    trace->offset += written;
+  }
+  return 0;
+}
+
+/* Encode a chunk header */
+static void
+sandglass_trace_chunk_header(unsigned char *header, unsigned long thread,
+                             unsigned long count, unsigned long size,
+                             unsigned long kind, long long first,
+                             long long last)
+{
+  unsigned char *p;
+
+  p = sandglass_put_u32(header, thread);
+  p = sandglass_put_u32(p, count);
+  p = sandglass_put_u32(p, size);
+  p = sandglass_put_u32(p, kind);
+  p = sandglass_put_u64(p, first);
+  sandglass_put_u64(p, last);
+}
+
+/*
+ * Append a chunk header and its payload, all or nothing: a half-written chunk
+ * would stop a reader recovering an unclosed trace from seeing any chunks
+ * after it
+ */
+static int
+sandglass_trace_write_chunk(sandglass_trace_t *trace,
+                            const unsigned char *header,
+                            const void *payload, size_t size)
+{
+  struct iovec iov[2];
+  long long start = trace->offset;
+  ssize_t written;
+  int i = 0, error;
+
+  iov[0].iov_base = (void *)header;
+  iov[0].iov_len  = SANDGLASS_TRACE_CHUNK_SIZE;
+  iov[1].iov_base = (void *)payload;
+  iov[1].iov_len  = size;
+
+  while (i < 2) {
+    written = writev(trace->fd, iov + i, 2 - i);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      goto rollback;
+    }
+    trace->offset += written;
+
+    /* Skip what was written, in case it was a short write */
+    for (; i < 2 && (size_t)written >= iov[i].iov_len; ++i) {
+      written -= iov[i].iov_len;
+    }
+    if (i < 2) {
+      iov[i].iov_base  = (char *)iov[i].iov_base + written;
+      iov[i].iov_len  -= written;
+    }
+  }
+  return 0;
+
+ rollback:
+  error = errno;
+  if (ftruncate(trace->fd, start) == 0
+      && lseek(trace->fd, start, SEEK_SET) == start)
+    trace->offset = start;
+  errno = error;
+  return -1;
+}
+
+int
+sandglass_trace_open(sandglass_trace_t *trace, const char *path, double freq)
+{
+  unsigned char header[SANDGLASS_TRACE_HEADER_SIZE], *p;
+  union { double d; unsigned long long u; } bits;
+
+  memset(trace, 0, sizeof(*trace));
+  trace->freq = freq;
+
+  trace->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (trace->fd < 0)
+    return -1;
+
+  bits.d = freq;
+  memcpy(header, SANDGLASS_TRACE_MAGIC, 8);
+  p = sandglass_put_u32(header + 8, SANDGLASS_TRACE_VERSION);
+  p = sandglass_put_u32(p, 0);
+  sandglass_put_u64(p, bits.u);
+
+  if (sandglass_trace_write(trace, header, sizeof(header)) != 0) {
+    close(trace->fd);
+    return -1;
+  }
+
+  pthread_mutex_init(&trace->mutex, NULL);
+  return 0;
+}
+
+int
+sandglass_trace_zone(sandglass_trace_t *trace, const char *name)
+{
+  unsigned char header[SANDGLASS_TRACE_CHUNK_SIZE], *payload, *p;
+  size_t len = strlen(name);
+  char **zones;
+  int zone;
+
+  pthread_mutex_lock(&trace->mutex);
+
+  for (zone = 0; zone < trace->nzones; ++zone) {
+    if (strcmp(trace->zones[zone], name) == 0)
+      goto done;
+  }
+
+  if (trace->nzones == trace->zones_capacity) {
+    trace->zones_capacity = trace->zones_capacity ? 2*trace->zones_capacity
+                                                  : 16;
+    zones = realloc(trace->zones, trace->zones_capacity*sizeof(char *));
+    if (!zones) {
+      zone = -1;
+      goto done;
+    }
+    trace->zones = zones;
+  }
+
+  trace->zones[zone] = malloc(len + 1);
+  payload = malloc(2*SANDGLASS_TRACE_VARINT_MAX + len);
+  if (!trace->zones[zone] || !payload) {
+    free(trace->zones[zone]);
+    free(payload);
+    zone = -1;
+    goto done;
+  }
+  strcpy(trace->zones[zone], name);
+
+  /* Define the zone in the file right away, so its name survives even if the
+     trace is never closed */
+  p = sandglass_put_varint(payload, zone);
+  p = sandglass_put_varint(p, len);
+  memcpy(p, name, len);
+  p += len;
+
+  sandglass_trace_chunk_header(header, 0, 1, p - payload,
+                               SANDGLASS_TRACE_ZONES, 0, 0);
+  if (sandglass_trace_write_chunk(trace, header, payload, p - payload) != 0) {
+    free(trace->zones[zone]);
+    zone = -1;
+  } else {
+    ++trace->nzones;
+  }
+  free(payload);
+
+ done:
+  pthread_mutex_unlock(&trace->mutex);
+  return zone;
+}
+
+void
+sandglass_trace_thread_init(sandglass_trace_thread_t *thread,
+                            sandglass_trace_t *trace)
+{
+  thread->trace = trace;
+  thread->count = 0;
+  thread->size  = 0;
+
+  pthread_mutex_lock(&trace->mutex);
+  thread->thread = trace->nthreads++;
+  pthread_mutex_unlock(&trace->mutex);
+}
+
+int
+sandglass_trace_record(sandglass_trace_thread_t *thread, int zone,
+                       long long begin, long long end)
+{
+  unsigned char *p;
+  long long delta;
+
+  if (zone < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (thread->size + SANDGLASS_TRACE_RECORD_MAX > SANDGLASS_TRACE_BUFFER) {
+    if (sandglass_trace_thread_flush(thread) != 0)
+      return -1;
+  }
+
+  end = begin + sandglass_ticks_between(begin, end);
+
+  if (thread->count == 0) {
+    thread->first = begin;
+    thread->last  = end;
+    thread->prev  = 0;
+  }
+
+  /* Zig-zag encode the signed delta; nested zones end (and are recorded)
+     before their parents, so begins aren't monotonic */
+  delta = begin - thread->prev;
+  p = thread->buffer + thread->size;
+  p = sandglass_put_varint(p, zone);
+  p = sandglass_put_varint(p, ((unsigned long long)delta << 1)
+                              ^ (delta < 0 ? ~0ULL : 0ULL));
+  p = sandglass_put_varint(p, end - begin);
+  thread->size = p - thread->buffer;
+
+  ++thread->count;
+  thread->prev = begin;
+  if (begin < thread->first)
+    thread->first = begin;
+  if (end > thread->last)
+    thread->last = end;
+  return 0;
+}
+
+int
+sandglass_trace_thread_flush(sandglass_trace_thread_t *thread)
+{
+  sandglass_trace_t *trace = thread->trace;
+  unsigned char header[SANDGLASS_TRACE_CHUNK_SIZE];
+  sandglass_trace_chunk_t *chunks, *chunk;
+  int ret = -1;
+
+  if (thread->count == 0)
+    return 0;
+
+  sandglass_trace_chunk_header(header, thread->thread, thread->count,
+                               thread->size, SANDGLASS_TRACE_RECORDS,
+                               thread->first, thread->last);
+
+  pthread_mutex_lock(&trace->mutex);
+
+  if (trace->nchunks == trace->chunks_capacity) {
+    trace->chunks_capacity = trace->chunks_capacity
+                             ? 2*trace->chunks_capacity : 64;
+    chunks = realloc(trace->chunks,
+                     trace->chunks_capacity*sizeof(sandglass_trace_chunk_t));
+    if (!chunks)
+      goto done;
+    trace->chunks = chunks;
+  }
+
+  chunk = &trace->chunks[trace->nchunks];
+  chunk->offset = trace->offset;
+  chunk->thread = thread->thread;
+  chunk->count  = thread->count;
+  chunk->first  = thread->first;
+  chunk->last   = thread->last;
+
+  if (sandglass_trace_write_chunk(trace, header, thread->buffer,
+                                  thread->size) != 0)
+    goto done;
+
+  ++trace->nchunks;
+  thread->count = 0;
+  thread->size  = 0;
+  ret = 0;
+
+ done:
+  pthread_mutex_unlock(&trace->mutex);
+  return ret;
+}
+
+int
+sandglass_trace_close(sandglass_trace_t *trace)
+{
+  unsigned char buf[SANDGLASS_TRACE_ENTRY_SIZE], *p;
+  long long zones_offset, index_offset;
+  size_t len;
+  long i;
+  int ret = -1;
+
+  /* Zone names */
+  zones_offset = trace->offset;
+  sandglass_put_u32(buf, trace->nzones);
+  if (sandglass_trace_write(trace, buf, 4) != 0)
+    goto done;
+  for (i = 0; i < trace->nzones; ++i) {
+    len = strlen(trace->zones[i]);
+    sandglass_put_u32(buf, len);
+    if (sandglass_trace_write(trace, buf, 4) != 0
+        || sandglass_trace_write(trace, trace->zones[i], len) != 0)
+      goto done;
+  }
+
+  /* The chunk index */
+  index_offset = trace->offset;
+  sandglass_put_u64(buf, trace->nchunks);
+  if (sandglass_trace_write(trace, buf, 8) != 0)
+    goto done;
+  for (i = 0; i < trace->nchunks; ++i) {
+    p = sandglass_put_u64(buf, trace->chunks[i].offset);
+    p = sandglass_put_u32(p, trace->chunks[i].thread);
+    p = sandglass_put_u32(p, trace->chunks[i].count);
+    p = sandglass_put_u64(p, trace->chunks[i].first);
+    sandglass_put_u64(p, trace->chunks[i].last);
+    if (sandglass_trace_write(trace, buf, SANDGLASS_TRACE_ENTRY_SIZE) != 0)
+      goto done;
+  }
+
+  /* The footer */
+  p = sandglass_put_u64(buf, zones_offset);
+  p = sandglass_put_u64(p, index_offset);
+  memcpy(p, SANDGLASS_TRACE_INDEX_MAGIC, 8);
+  if (sandglass_trace_write(trace, buf, SANDGLASS_TRACE_FOOTER_SIZE) != 0)
+    goto done;
+
+  ret = 0;
+
+ done:
+  if (close(trace->fd) != 0)
+    ret = -1;
+  for (i = 0; i < trace->nzones; ++i) {
+    free(trace->zones[i]);
+  }
+  free(trace->zones);
+  free(trace->chunks);
+  pthread_mutex_destroy(&trace->mutex);
+  return ret;
+}
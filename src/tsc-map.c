@@ -0,0 +1,236 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "sandglass-impl.h"
+#include "sandglass.h"
+#include <time.h>
+#include <errno.h>
+
+/* Number of paired reads to take when looking for the tightest bracket */
+#define SANDGLASS_TSC_MAP_TRIES 16
+
+#if SANDGLASS_TSC
+
+/* Convert a timespec to nanoseconds */
+static long long
+sandglass_timespec_ns(const struct timespec *ts)
+{
+  return ts->tv_sec*1000000000LL + ts->tv_nsec;
+}
+
+/*
+ * Take a reference point.  The clocks are read between two TSC reads, and the
+ * attempt with the least time between them wins.
+ */
+static int
+sandglass_tsc_point(sandglass_tsc_point_t *point)
+{
+  struct timespec monotonic, realtime;
+  long long before, after, best = -1;
+  int i;
+
+  for (i = 0; i < SANDGLASS_TSC_MAP_TRIES; ++i) {
+    before = sandglass_get_tsc();
+    if (clock_gettime(CLOCK_MONOTONIC, &monotonic) != 0)
+      return -1;
+    if (clock_gettime(CLOCK_REALTIME, &realtime) != 0)
+      return -1;
+    after = sandglass_get_tsc();
+
+    if (best < 0 || after - before < best) {
+      best = after - before;
+      point->tsc       = before + best/2;
+      point->error     = (best + 1)/2;
+      point->monotonic = sandglass_timespec_ns(&monotonic);
+      point->realtime  = sandglass_timespec_ns(&realtime);
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Fields of the map are accessed with relaxed atomics, since readers may race
+ * with an update; the sequence lock tells them to retry if they did
+ */
+static void
+sandglass_tsc_point_load(const sandglass_tsc_point_t *src,
+                         sandglass_tsc_point_t *dest)
+{
+  dest->tsc       = __atomic_load_n(&src->tsc, __ATOMIC_RELAXED);
+  dest->error     = __atomic_load_n(&src->error, __ATOMIC_RELAXED);
+  dest->monotonic = __atomic_load_n(&src->monotonic, __ATOMIC_RELAXED);
+  dest->realtime  = __atomic_load_n(&src->realtime, __ATOMIC_RELAXED);
+}
+
+static void
+sandglass_tsc_point_store(sandglass_tsc_point_t *dest,
+                          const sandglass_tsc_point_t *src)
+{
+  __atomic_store_n(&dest->tsc, src->tsc, __ATOMIC_RELAXED);
+  __atomic_store_n(&dest->error, src->error, __ATOMIC_RELAXED);
+  __atomic_store_n(&dest->monotonic, src->monotonic, __ATOMIC_RELAXED);
+  __atomic_store_n(&dest->realtime, src->realtime, __ATOMIC_RELAXED);
+}
+
+/* Find the reference points to interpolate tsc between */
+static int
+sandglass_tsc_segment(const sandglass_tsc_map_t *map, long long tsc,
+                      sandglass_tsc_point_t *a, sandglass_tsc_point_t *b)
+{
+  int npoints, lo = 0, hi, mid;
+
+  npoints = __atomic_load_n(&map->npoints, __ATOMIC_RELAXED);
+  if (npoints < 1 || npoints > SANDGLASS_TSC_MAP_POINTS) {
+    /* Torn read; the caller will retry */
+    return 0;
+  }
+
+  /* Find the segment containing tsc, extrapolating from the ends */
+  hi = npoints - 1;
+  while (hi - lo > 1) {
+    mid = lo + (hi - lo)/2;
+    if (__atomic_load_n(&map->points[mid].tsc, __ATOMIC_RELAXED) <= tsc) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  sandglass_tsc_point_load(&map->points[lo], a);
+  sandglass_tsc_point_load(&map->points[hi], b);
+  return npoints;
+}
+
+/* Map tsc to a clock by interpolating between reference points */
+static void
+sandglass_tsc_interpolate(const sandglass_tsc_map_t *map, long long tsc,
+                          int realtime, long long *ns)
+{
+  sandglass_tsc_point_t a, b;
+  unsigned long sequence;
+  long long a_ns, b_ns;
+  double slope;
+  int npoints;
+
+  /* Retry until we see a consistent snapshot */
+  do {
+    sequence = __atomic_load_n(&map->sequence, __ATOMIC_ACQUIRE);
+    npoints = sandglass_tsc_segment(map, tsc, &a, &b);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((sequence & 1)
+           || sequence != __atomic_load_n(&map->sequence, __ATOMIC_RELAXED)
+           || npoints == 0);
+
+  a_ns = realtime ? a.realtime : a.monotonic;
+  b_ns = realtime ? b.realtime : b.monotonic;
+  if (npoints < 2) {
+    /* Nothing to interpolate with; use the nominal frequency */
+    slope = 1.0e9/sandglass_tsc_freq();
+  } else {
+    slope = (double)(b_ns - a_ns)/(b.tsc - a.tsc);
+  }
+  *ns = a_ns + (long long)((tsc - a.tsc)*slope);
+}
+
+#endif /* SANDGLASS_TSC */
+
+int
+sandglass_tsc_map_init(sandglass_tsc_map_t *map)
+{
+  map->npoints  = 0;
+  map->sequence = 0;
+  return sandglass_tsc_map_update(map);
+}
+
+int
+sandglass_tsc_map_update(sandglass_tsc_map_t *map)
+{
+#if SANDGLASS_TSC
+  sandglass_tsc_point_t point, moved;
+  unsigned long sequence;
+  int i, npoints, ret = 0;
+
+  if (sandglass_tsc_point(&point) != 0)
+    return -1;
+
+  /* Take the write side of the sequence lock, by making it odd */
+  do {
+    sequence = __atomic_load_n(&map->sequence, __ATOMIC_RELAXED) & ~1UL;
+  } while (!__atomic_compare_exchange_n(&map->sequence, &sequence,
+                                        sequence + 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  npoints = map->npoints;
+  if (npoints > 0 && point.tsc <= map->points[npoints - 1].tsc) {
+    /* The TSC went backwards, e.g. because we migrated to an unsynchronized
+       CPU; a non-monotonic map would be useless */
+    ret = -1;
+  } else {
+    if (npoints == SANDGLASS_TSC_MAP_POINTS) {
+      /* Drop every other point, keeping the oldest one */
+      for (i = 1; 2*i < SANDGLASS_TSC_MAP_POINTS; ++i) {
+        moved = map->points[2*i];
+        sandglass_tsc_point_store(&map->points[i], &moved);
+      }
+      npoints = i;
+    }
+
+    sandglass_tsc_point_store(&map->points[npoints++], &point);
+    __atomic_store_n(&map->npoints, npoints, __ATOMIC_RELAXED);
+  }
+
+  __atomic_store_n(&map->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+  if (ret != 0)
+    errno = EAGAIN;
+  return ret;
+#else
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
+
+int
+sandglass_tsc_to_monotonic(const sandglass_tsc_map_t *map, long long tsc,
+                           long long *ns)
+{
+#if SANDGLASS_TSC
+  sandglass_tsc_interpolate(map, tsc, 0, ns);
+  return 0;
+#else
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
+
+int
+sandglass_tsc_to_realtime(const sandglass_tsc_map_t *map, long long tsc,
+                          long long *ns)
+{
+#if SANDGLASS_TSC
+  sandglass_tsc_interpolate(map, tsc, 1, ns);
+  return 0;
+#else
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
@@ -20,34 +20,46 @@
 
 #include "sandglass-impl.h"
 #include "sandglass.h"
+#include <pthread.h>
 #include <time.h>
 #include <unistd.h>
 
-/* Gets the number of clock ticks per second */
-double
-sandglass_tsc_freq()
+/* The number of clock ticks per second, measured once */
+static double sandglass_tsc_hz;
+static pthread_once_t sandglass_tsc_once = PTHREAD_ONCE_INIT;
+
+/* Measure the TSC frequency against the system clock */
+static void
+sandglass_tsc_measure(void)
 {
-  static long tsc = 0;
-  static struct timespec ts = { .tv_sec = 0, .tv_nsec = 10000000L };
+  struct timespec ts = { .tv_sec = 0, .tv_nsec = 10000000L };
   struct timespec curr, until;
+  long long tsc;
+
+  sandglass_get_currtime(&curr);
+  until = curr;
+  sandglass_timespec_add(&until, &ts);
+  tsc = sandglass_get_tsc();
 
-  if (tsc == 0) {
+  /* Spin */
+  do {
     sandglass_get_currtime(&curr);
-    until = curr;
-    sandglass_timespec_add(&until, &ts);
-    tsc = sandglass_get_tsc();
+  } while (sandglass_timespec_cmp(&curr, &until) < 0);
 
-    /* Spin */
-    do {
-      sandglass_get_currtime(&curr);
-    } while (sandglass_timespec_cmp(&curr, &until) < 0);
+  tsc = sandglass_get_tsc() - tsc;
 
-    tsc = sandglass_get_tsc() - tsc;
+  /* Adjust ts to the time actually waited */
+  sandglass_timespec_sub(&curr, &until);
+  sandglass_timespec_add(&ts, &curr);
 
-    /* Adjust ts to the time actually waited */
-    sandglass_timespec_sub(&curr, &until);
-    sandglass_timespec_add(&ts, &curr);
-  }
+  sandglass_tsc_hz = tsc*1.0e9/(ts.tv_sec*1.0e9 + ts.tv_nsec);
+}
 
-  return tsc*1.0e9/ts.tv_nsec;
+/* Gets the number of clock ticks per second */
+double
+sandglass_tsc_freq()
+{
+  /* Multiple threads may ask at once, e.g. through sandglass_ticks_freq() */
+  pthread_once(&sandglass_tsc_once, sandglass_tsc_measure);
+  return sandglass_tsc_hz;
 }
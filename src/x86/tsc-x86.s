@@ -23,19 +23,23 @@
  */
 
         .text
-/* long sandglass_get_tsc(); */
+/* long long sandglass_get_tsc(); */
 .globl sandglass_get_tsc
         .type sandglass_get_tsc, @function
 sandglass_get_tsc:
         pushl %ebx              /* Callee-save register, clobbered by cpuid */
         pushl %esi
+        pushl %edi
         xorl %eax, %eax         /* Make cpuid do a consistent operation */
         cpuid                   /* Serialize */
-        rdtsc                   /* Read time stamp counter */
+        rdtsc                   /* Read time stamp counter into edx:eax */
         movl %eax, %esi         /* Store tsc */
+        movl %edx, %edi
         xorl %eax, %eax
         cpuid                   /* Serialize again */
         movl %esi, %eax
+        movl %edi, %edx
+        popl %edi
         popl %esi
         popl %ebx
         ret
@@ -57,3 +61,16 @@ sandglass_tsc_loops:
         jz .Lrdtsc              /* If we got the same value, try again */
         ret
         .size sandglass_tsc_loops, .-sandglass_tsc_loops
+
+/*
+ * Return the time stamp counter without serializing; cheaper, but may be
+ * reordered with surrounding instructions
+ */
+
+/* long long sandglass_get_tsc_unserialized(); */
+.globl sandglass_get_tsc_unserialized
+        .type sandglass_get_tsc_unserialized, @function
+sandglass_get_tsc_unserialized:
+        rdtsc                   /* Read time stamp counter into edx:eax */
+        ret
+        .size sandglass_get_tsc_unserialized, .-sandglass_get_tsc_unserialized
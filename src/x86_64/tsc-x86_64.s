@@ -23,7 +23,7 @@
  */
 
         .text
-/* long sandglass_get_tsc(); */
+/* long long sandglass_get_tsc(); */
 .globl sandglass_get_tsc
         .type sandglass_get_tsc, @function
 sandglass_get_tsc:
@@ -57,3 +57,18 @@ sandglass_tsc_loops:
         jz .Lrdtsc              /* If we got the same value, try again */
         ret
         .size sandglass_tsc_loops, .-sandglass_tsc_loops
+
+/*
+ * Return the time stamp counter without serializing; cheaper, but may be
+ * reordered with surrounding instructions
+ */
+
+/* long long sandglass_get_tsc_unserialized(); */
+.globl sandglass_get_tsc_unserialized
+        .type sandglass_get_tsc_unserialized, @function
+sandglass_get_tsc_unserialized:
+        rdtsc                   /* Read time stamp counter */
+        shlq $32, %rdx
+        orq %rdx, %rax
+        ret
+        .size sandglass_get_tsc_unserialized, .-sandglass_get_tsc_unserialized
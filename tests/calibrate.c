@@ -0,0 +1,149 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "../src/sandglass-impl.h"
+#include "../src/sandglass.h"
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* A recognizable overhead to plant in the calibration file */
+#define KNOWN_OVERHEAD 12345
+
+/* Run in a fresh process, which must load the planted calibration */
+static int
+check_load()
+{
+  sandglass_t sandglass;
+
+  if (sandglass_init_monotonic(&sandglass, SANDGLASS_SYSTEM) != 0) {
+    perror("sandglass_init_monotonic()");
+    return EXIT_FAILURE;
+  }
+
+  if (sandglass.baseline != KNOWN_OVERHEAD
+      || sandglass.loop_baseline != KNOWN_OVERHEAD) {
+    fprintf(stderr, "Calibration wasn't loaded (baseline %ld)!\n",
+            sandglass.baseline);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+int
+main(int argc, char *argv[])
+{
+  sandglass_t sandglass, again;
+  char path[] = "calibrate-test.XXXXXX", key[3][256];
+  FILE *file;
+  pid_t pid;
+  int fd, i, status;
+
+  if (argc > 1)
+    return check_load();
+
+  /* Calibrate into a fresh file */
+  fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp()");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  setenv("SANDGLASS_CALIBRATION_FILE", path, 1);
+
+  if (sandglass_init_monotonic(&sandglass, SANDGLASS_SYSTEM) != 0
+      || sandglass_init_monotonic(&again, SANDGLASS_SYSTEM) != 0) {
+    perror("sandglass_init_monotonic()");
+    remove(path);
+    return EXIT_FAILURE;
+  }
+
+  if (sandglass.baseline < 0 || sandglass.loop_baseline < sandglass.baseline
+      || again.baseline != sandglass.baseline) {
+    fprintf(stderr, "Bad calibration!\n");
+    remove(path);
+    return EXIT_FAILURE;
+  }
+
+  /* An empty benchmark can't take negative time */
+  sandglass_bench(&sandglass, SANDGLASS_NO_UNROLL());
+  if (sandglass.grains < 0) {
+    fprintf(stderr, "Negative time!\n");
+    remove(path);
+    return EXIT_FAILURE;
+  }
+
+  /* The calibration should have been saved, if we can identify the machine */
+  file = fopen(path, "r");
+  if (!file) {
+    perror("fopen()");
+    remove(path);
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < 3 && fgets(key[i], sizeof(key[i]), file); ++i);
+  fclose(file);
+
+  if (i < 3) {
+    if (access("/proc/sys/kernel/random/boot_id", R_OK) == 0) {
+      fprintf(stderr, "Calibration wasn't saved!\n");
+      remove(path);
+      return EXIT_FAILURE;
+    }
+  } else {
+    /* Plant a known calibration under the same key, and re-exec ourselves
+       so the new process has to load it */
+    file = fopen(path, "w");
+    if (!file) {
+      perror("fopen()");
+      remove(path);
+      return EXIT_FAILURE;
+    }
+    fprintf(file, "%s%s%s", key[0], key[1], key[2]);
+    for (i = 0; i < 4; ++i) {
+      fprintf(file, "clock %d %d %d 0\n", i/2, i%2, KNOWN_OVERHEAD);
+    }
+    fclose(file);
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) {
+      perror("fork()");
+      remove(path);
+      return EXIT_FAILURE;
+    } else if (pid == 0) {
+      execl("/proc/self/exe", argv[0], "--load", (char *)NULL);
+      perror("execl()");
+      _exit(EXIT_FAILURE);
+    }
+
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)
+        || WEXITSTATUS(status) != EXIT_SUCCESS) {
+      remove(path);
+      return EXIT_FAILURE;
+    }
+  }
+  remove(path);
+
+  printf("%ld %ld\n", sandglass.baseline, sandglass.loop_baseline);
+
+  return EXIT_SUCCESS;
+}
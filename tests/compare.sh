@@ -0,0 +1,64 @@
+#! /bin/sh
+
+###########################################################################
+## Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               ##
+##                                                                       ##
+## This file is part of The FPFD Library Build Suite.                    ##
+##                                                                       ##
+## The FPFD Library Build Suite is free software; you can redistribute   ##
+## it and/or modify it under the terms of the GNU General Public License ##
+## as published by the Free Software Foundation; either version 3 of the ##
+## License, or (at your option) any later version.                       ##
+##                                                                       ##
+## The FPFD Library Build Suite is distributed in the hope that it will  ##
+## be useful, but WITHOUT ANY WARRANTY; without even the implied         ##
+## warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See ##
+## the GNU General Public License for more details.                      ##
+##                                                                       ##
+## You should have received a copy of the GNU General Public License     ##
+## along with this program.  If not, see <http://www.gnu.org/licenses/>. ##
+###########################################################################
+
+
+compare=../tools/sandglass-compare
+tmp=compare-test.$$
+trap 'rm -f $tmp.*' EXIT
+
+i=0
+while [ $i -lt 20 ]; do
+  echo "sort/1024 $((100 + i % 5))" >>$tmp.baseline
+  echo "sort/1024 $((101 + i % 5))" >>$tmp.noise
+  echo "sort/1024 $((120 + i % 5))" >>$tmp.regression
+  i=$((i + 1))
+done
+
+# Small differences shouldn't fail
+$compare $tmp.baseline $tmp.noise || exit 1
+
+# Large ones should
+$compare $tmp.baseline $tmp.regression
+test $? -eq 1 || exit 1
+
+# Unless we tolerate them
+$compare --threshold=25 $tmp.baseline $tmp.regression || exit 1
+
+# Garbage input is an error
+echo "sort/1024 fast" >$tmp.garbage
+$compare $tmp.baseline $tmp.garbage
+test $? -eq 2 || exit 1
+
+# So is a zero baseline, which has no relative change
+i=0
+while [ $i -lt 20 ]; do
+  echo "sort/1024 0" >>$tmp.zero
+  i=$((i + 1))
+done
+$compare $tmp.zero $tmp.baseline
+test $? -eq 2 || exit 1
+
+# A benchmark missing from the candidate is an error, unless allowed
+cat $tmp.baseline >$tmp.extra
+echo "search/1024 50" >>$tmp.extra
+$compare $tmp.extra $tmp.baseline
+test $? -eq 2 || exit 1
+$compare --allow-missing $tmp.extra $tmp.baseline || exit 1
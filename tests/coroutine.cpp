@@ -0,0 +1,102 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "../src/sandglass-coroutine.hpp"
+#include "../src/sandglass.h"
+#include <chrono>
+#include <coroutine>
+#include <thread>
+#include <cstdlib>
+#include <cstdio>
+
+namespace
+{
+  // A coroutine which runs eagerly and is never awaited
+  struct task
+  {
+    struct promise_type
+    {
+      task get_return_object() { return {}; }
+      std::suspend_never initial_suspend() { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+      void return_void() { }
+      void unhandled_exception() { std::abort(); }
+    };
+  };
+
+  // Suspends until someone else resumes us
+  struct event
+  {
+    std::coroutine_handle<> waiter;
+
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { waiter = handle; }
+    int await_resume() { return 42; }
+  };
+
+  void
+  spin(std::chrono::milliseconds duration)
+  {
+    auto until = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < until) { }
+  }
+
+  task
+  request(sandglass_t& sandglass, event& io, bool& ok)
+  {
+    sandglass_resume(&sandglass);
+    spin(std::chrono::milliseconds(50));
+    ok = co_await sandglass::timed(sandglass, io) == 42;
+    spin(std::chrono::milliseconds(50));
+    sandglass_pause(&sandglass);
+  }
+}
+
+int
+main()
+{
+  sandglass_t sandglass;
+  event io;
+  bool ok = false;
+
+  if (sandglass_init_monotonic(&sandglass, SANDGLASS_SYSTEM) != 0) {
+    std::perror("sandglass_init_monotonic()");
+    return EXIT_FAILURE;
+  }
+
+  request(sandglass, io, ok);
+
+  // Resume the request on a different thread, after a while
+  std::thread worker([&] {
+    spin(std::chrono::milliseconds(100));
+    io.waiter.resume();
+  });
+  worker.join();
+
+  double total = sandglass.total/sandglass.freq;
+  if (!ok || sandglass.segments != 2 || total < 0.1 || total > 0.15) {
+    std::fprintf(stderr, "Suspended time was counted!\n");
+    return EXIT_FAILURE;
+  }
+
+  std::printf("%.15g\n", total);
+
+  return EXIT_SUCCESS;
+}
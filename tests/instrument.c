@@ -0,0 +1,93 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "../src/sandglass-impl.h"
+#include "../src/sandglass.h"
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define CATEGORY_IO  0x1UL
+#define CATEGORY_CPU 0x2UL
+
+static sandglass_zone_t zone = SANDGLASS_ZONE_INITIALIZER("zone", CATEGORY_IO);
+static sandglass_counter_t counter
+  = SANDGLASS_COUNTER_INITIALIZER("counter", CATEGORY_CPU);
+
+/* An instrumented function */
+static void
+instrumented(void)
+{
+  long long start = sandglass_zone_enter(&zone);
+  sandglass_count(&counter, 1);
+  sandglass_zone_leave(&zone, start);
+}
+
+int
+main()
+{
+  sandglass_t sandglass;
+
+  if (sandglass_init_monotonic(&sandglass, SANDGLASS_CPUTIME) != 0
+      && sandglass_init_monotonic(&sandglass, SANDGLASS_SYSTEM) != 0) {
+    perror("sandglass_init_monotonic()");
+    return EXIT_FAILURE;
+  }
+
+  /* Measure the cost of disabled instrumentation */
+  sandglass_disable(SANDGLASS_ALL_CATEGORIES);
+  sandglass_bench_fine(&sandglass, instrumented());
+  if (zone.count != 0 || counter.value != 0) {
+    fprintf(stderr, "Disabled instrumentation recorded something!\n");
+    return EXIT_FAILURE;
+  }
+  printf("disabled: %ld\n", sandglass.grains);
+
+  /* Only the zone's category */
+  sandglass_enable(CATEGORY_IO);
+  instrumented();
+  if (zone.count != 1 || counter.value != 0) {
+    fprintf(stderr, "Categories were not respected!\n");
+    return EXIT_FAILURE;
+  }
+
+  /* Toggle everything off, and back on, by signal */
+  if (sandglass_enable_signal(SIGUSR2) != 0) {
+    perror("sandglass_enable_signal()");
+    return EXIT_FAILURE;
+  }
+  raise(SIGUSR2);
+  instrumented();
+  raise(SIGUSR2);
+  {
+    SANDGLASS_SCOPE(&zone);
+    sandglass_count(&counter, 1);
+  }
+  if (zone.count != 2 || counter.value != 0) {
+    fprintf(stderr, "Signal toggling failed!\n");
+    return EXIT_FAILURE;
+  }
+
+  sandglass_enable(SANDGLASS_ALL_CATEGORIES);
+  sandglass_bench_fine(&sandglass, instrumented());
+  printf("enabled: %ld\n", sandglass.grains);
+
+  return EXIT_SUCCESS;
+}
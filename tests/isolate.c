@@ -0,0 +1,89 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#define _GNU_SOURCE
+#include "../src/sandglass-impl.h"
+#include "../src/sandglass.h"
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+int
+main()
+{
+  int i = 0, cpu;
+  cpu_set_t cpus;
+  sandglass_t sandglass;
+  sandglass_isolation_t isolation = { .cpu = -1, .max_memory = 0,
+                                      .max_seconds = 10 };
+  struct timespec tosleep = { .tv_sec = 0, .tv_nsec = 111111111L };
+
+  /* Pin to a CPU we're actually allowed to run on (cpusets, taskset) */
+  if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) {
+    perror("sched_getaffinity()");
+    return EXIT_FAILURE;
+  }
+  for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &cpus)) {
+      isolation.cpu = cpu;
+      break;
+    }
+  }
+  if (isolation.cpu < 0) {
+    /* Skip the test */
+    return 77;
+  }
+
+  if (sandglass_init_monotonic(&sandglass, SANDGLASS_SYSTEM) != 0) {
+    perror("sandglass_init_monotonic()");
+    return EXIT_FAILURE;
+  }
+
+  /* A crashing benchmark shouldn't take us down with it */
+  sandglass_bench_isolated(&sandglass, &isolation, sandglass_bench_noprecache,
+                           raise(SIGKILL));
+  if (isolation.error != ECHILD || !WIFSIGNALED(isolation.status)) {
+    fprintf(stderr, "Crash was not reported!\n");
+    return EXIT_FAILURE;
+  }
+
+  sandglass_bench_isolated(&sandglass, &isolation, sandglass_bench_noprecache, {
+    sandglass_spin(&tosleep);
+    ++i;
+  });
+  if (isolation.error != 0) {
+    errno = isolation.error;
+    perror("sandglass_bench_isolated()");
+    return EXIT_FAILURE;
+  }
+
+  if (i != 0) {
+    fprintf(stderr, "Benchmark ran in the parent process!\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%.15g\n", sandglass.grains/sandglass.freq);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "../src/sandglass-impl.h"
+#include "../src/sandglass-lock.h"
+#include "../src/sandglass.h"
+#include <pthread.h>
+#include <time.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+#define ITERATIONS 10000
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static sandglass_lockstat_t stat
+  = SANDGLASS_LOCKSTAT_INITIALIZER(SANDGLASS_LOCKSTAT_HERE);
+static long counter = 0;
+static int started = 0, signalled = 0;
+
+static pthread_mutex_t robust;
+static sandglass_lockstat_t robust_stat
+  = SANDGLASS_LOCKSTAT_INITIALIZER(SANDGLASS_LOCKSTAT_HERE);
+
+static void *
+worker(void *ptr)
+{
+  sandglass_lock_t lock;
+  int i;
+
+  (void)ptr;
+
+  __atomic_fetch_add(&started, 1, __ATOMIC_SEQ_CST);
+
+  for (i = 0; i < ITERATIONS; ++i) {
+    sandglass_mutex_lock(&lock, &stat, &mutex);
+    ++counter;
+    sandglass_mutex_unlock(&lock, &mutex);
+  }
+
+  return NULL;
+}
+
+static void *
+signaller(void *ptr)
+{
+  sandglass_lock_t lock;
+
+  (void)ptr;
+
+  sandglass_mutex_lock(&lock, &stat, &mutex);
+  signalled = 1;
+  pthread_cond_signal(&cond);
+  sandglass_mutex_unlock(&lock, &mutex);
+  return NULL;
+}
+
+/* Exit while holding the robust mutex */
+static void *
+abandoner(void *ptr)
+{
+  sandglass_lock_t lock;
+
+  (void)ptr;
+
+  sandglass_mutex_lock(&lock, &robust_stat, &robust);
+  return NULL;
+}
+
+static long
+sum(const long *hist)
+{
+  long total = 0;
+  int i;
+  for (i = 0; i < SANDGLASS_LOCKSTAT_BUCKETS; ++i) {
+    total += hist[i];
+  }
+  return total;
+}
+
+int
+main()
+{
+  struct timespec tosleep = { .tv_sec = 0, .tv_nsec = 11111111L };
+  pthread_t threads[2], thread;
+  pthread_mutexattr_t attr;
+  sandglass_lock_t lock;
+  int i;
+
+  /* Hold the lock while the workers start, so they have to wait for it */
+  sandglass_mutex_lock(&lock, &stat, &mutex);
+  for (i = 0; i < 2; ++i) {
+    if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+      perror("pthread_create()");
+      return EXIT_FAILURE;
+    }
+  }
+  while (__atomic_load_n(&started, __ATOMIC_SEQ_CST) < 2);
+  sandglass_spin(&tosleep);
+  sandglass_mutex_unlock(&lock, &mutex);
+
+  for (i = 0; i < 2; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  /* The signaller can't get the mutex until we're waiting */
+  sandglass_mutex_lock(&lock, &stat, &mutex);
+  if (pthread_create(&thread, NULL, signaller, NULL) != 0) {
+    perror("pthread_create()");
+    return EXIT_FAILURE;
+  }
+  while (!signalled) {
+    sandglass_cond_wait(&lock, &cond, &mutex);
+  }
+  sandglass_mutex_unlock(&lock, &mutex);
+  pthread_join(thread, NULL);
+
+  if (counter != 2*ITERATIONS || stat.count != 2*ITERATIONS + 3) {
+    fprintf(stderr, "Wrong acquisition count %ld!\n", stat.count);
+    return EXIT_FAILURE;
+  }
+
+  if (sum(stat.wait_hist) != stat.count || sum(stat.hold_hist) != stat.count) {
+    fprintf(stderr, "Histograms don't match acquisition count!\n");
+    return EXIT_FAILURE;
+  }
+
+  if (stat.contended < 2 || stat.wait_ticks <= 0) {
+    fprintf(stderr, "Contention wasn't recorded!\n");
+    return EXIT_FAILURE;
+  }
+
+  if (sum(stat.cond_hist) == 0 || stat.cond_ticks <= 0) {
+    fprintf(stderr, "Condition wait wasn't recorded!\n");
+    return EXIT_FAILURE;
+  }
+
+  /* A robust mutex whose owner died is acquired, with EOWNERDEAD */
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&robust, &attr);
+  pthread_mutexattr_destroy(&attr);
+  if (pthread_create(&thread, NULL, abandoner, NULL) != 0) {
+    perror("pthread_create()");
+    return EXIT_FAILURE;
+  }
+  pthread_join(thread, NULL);
+
+  if (sandglass_mutex_lock(&lock, &robust_stat, &robust) != EOWNERDEAD) {
+    fprintf(stderr, "Dead owner wasn't reported!\n");
+    return EXIT_FAILURE;
+  }
+  pthread_mutex_consistent(&robust);
+  if (sandglass_mutex_unlock(&lock, &robust) != 0 || robust_stat.count != 1) {
+    fprintf(stderr, "Robust mutex acquisition wasn't recorded!\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%s: %ld/%ld contended, %.15g s waiting, %.15g s holding\n",
+         stat.site, stat.contended, stat.count,
+         stat.wait_ticks/sandglass_ticks_freq(),
+         stat.hold_ticks/sandglass_ticks_freq());
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "../src/sandglass-impl.h"
+#include "../src/sandglass.h"
+#include <pthread.h>
+#include <time.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define THREADS    4
+#define ITERATIONS 100000
+
+static sandglass_meter_t meter;
+
+static void *
+worker(void *ptr)
+{
+  int i;
+
+  (void)ptr;
+
+  for (i = 0; i < ITERATIONS; ++i) {
+    sandglass_meter_record(&meter, 1, 10);
+  }
+  return NULL;
+}
+
+int
+main()
+{
+  pthread_t threads[THREADS];
+  struct timespec tosleep = { .tv_sec = 0, .tv_nsec = 111111111L };
+  int i;
+
+  sandglass_meter_init(&meter);
+  sandglass_meter_update(&meter);
+
+  for (i = 0; i < THREADS; ++i) {
+    if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+      perror("pthread_create()");
+      return EXIT_FAILURE;
+    }
+  }
+  for (i = 0; i < THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  sandglass_spin(&tosleep);
+  sandglass_meter_update(&meter);
+
+  if (meter.events != THREADS*ITERATIONS
+      || meter.bytes != 10L*THREADS*ITERATIONS) {
+    fprintf(stderr, "Lost events: %lld/%lld!\n", meter.events, meter.bytes);
+    return EXIT_FAILURE;
+  }
+
+  if (meter.rate <= 0.0 || meter.peak != meter.rate
+      || meter.byte_rate < 9.99*meter.rate || meter.byte_rate > 10.01*meter.rate
+      || meter.ewma[0] <= meter.ewma[1] || meter.ewma[1] <= meter.ewma[2]) {
+    fprintf(stderr, "Implausible rates!\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%.15g %.15g %.15g %.15g\n",
+         meter.rate, meter.ewma[0], meter.ewma[1], meter.ewma[2]);
+
+  return EXIT_SUCCESS;
+}
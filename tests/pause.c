@@ -0,0 +1,74 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "../src/sandglass-impl.h"
+#include "../src/sandglass.h"
+#include <unistd.h>
+#include <time.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+int
+main()
+{
+  sandglass_t sandglass, longer;
+  struct timespec tosleep = { .tv_sec = 0, .tv_nsec = 55555555L };
+  struct timespec tolong = { .tv_sec = 1, .tv_nsec = 222222222L };
+  double total;
+  int i;
+
+  if (sandglass_init_monotonic(&sandglass, SANDGLASS_SYSTEM) != 0) {
+    perror("sandglass_init_monotonic()");
+    return EXIT_FAILURE;
+  }
+
+  for (i = 0; i < 2; ++i) {
+    sandglass_resume(&sandglass);
+    sandglass_spin(&tosleep);
+    sandglass_pause(&sandglass);
+
+    /* Not counted */
+    sandglass_spin(&tosleep);
+  }
+
+  total = sandglass.total/sandglass.freq;
+  if (sandglass.segments != 2 || total < 0.111 || total > 0.2) {
+    fprintf(stderr, "Paused time was counted!\n");
+    return EXIT_FAILURE;
+  }
+
+  /* Segments longer than a second keep their whole seconds */
+  if (sandglass_init_monotonic(&longer, SANDGLASS_SYSTEM) != 0) {
+    perror("sandglass_init_monotonic()");
+    return EXIT_FAILURE;
+  }
+  sandglass_resume(&longer);
+  nanosleep(&tolong, NULL);
+  sandglass_pause(&longer);
+  if (longer.total/longer.freq < 1.222 || longer.total/longer.freq > 2.0) {
+    fprintf(stderr, "Long segment was truncated to %.15g s!\n",
+            longer.total/longer.freq);
+    return EXIT_FAILURE;
+  }
+
+  printf("%.15g\n", total);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,302 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "../src/sandglass-impl.h"
+#include "../src/sandglass-trace.h"
+#include "../src/sandglass.h"
+#include <sys/resource.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#define THREADS    2
+#define ITERATIONS 100000
+
+static sandglass_trace_t trace;
+static int outer, inner;
+
+static void *
+worker(void *ptr)
+{
+  sandglass_trace_thread_t *thread = malloc(sizeof(sandglass_trace_thread_t));
+  long long base = (long)ptr*1000000000LL, begin;
+  int i;
+
+  sandglass_trace_thread_init(thread, &trace);
+  for (i = 0; i < ITERATIONS; ++i) {
+    /* Nested zones are recorded inner first */
+    begin = base + i*1000L;
+    sandglass_trace_record(thread, inner, begin + 10, begin + 10 + i%50);
+    sandglass_trace_record(thread, outer, begin, begin + 100);
+  }
+  sandglass_trace_thread_flush(thread);
+
+  free(thread);
+  return NULL;
+}
+
+/* Write size bytes of data to path */
+static int
+write_file(const char *path, const unsigned char *data, size_t size)
+{
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return -1;
+  if (fwrite(data, 1, size, file) != size) {
+    fclose(file);
+    return -1;
+  }
+  return fclose(file);
+}
+
+/* Check that a trace cut off at size bytes yields the count records in the
+   chunks before that point */
+static int
+check_truncated(const sandglass_trace_reader_t *reader, const char *path,
+                size_t size, long nchunks, long count)
+{
+  sandglass_trace_reader_t salvaged;
+  long counts[2];
+  long long totals[2];
+  int ret = -1;
+
+  if (write_file(path, reader->map, size) != 0) {
+    perror("write_file()");
+    return -1;
+  }
+
+  if (sandglass_trace_reader_open(&salvaged, path) != 0) {
+    perror("sandglass_trace_reader_open()");
+    return -1;
+  }
+
+  if (salvaged.nchunks != nchunks || salvaged.nzones != 2
+      || strcmp(salvaged.zones[outer], "outer") != 0
+      || strcmp(salvaged.zones[inner], "inner") != 0
+      || sandglass_trace_totals(&salvaged, LLONG_MIN, LLONG_MAX, counts, totals)
+         != 0
+      || counts[outer] + counts[inner] != count) {
+    fprintf(stderr, "Wrong recovery of a %lu-byte trace!\n",
+            (unsigned long)size);
+    goto close;
+  }
+  ret = 0;
+
+ close:
+  sandglass_trace_reader_close(&salvaged);
+  return ret;
+}
+
+/* Check that a chunk cut short by a failed write is rolled back */
+static int
+check_rollback(const char *path)
+{
+  sandglass_trace_t partial;
+  sandglass_trace_thread_t *thread = malloc(sizeof(sandglass_trace_thread_t));
+  sandglass_trace_reader_t reader;
+  struct rlimit limit, old;
+  long long offset, totals[1];
+  long counts[1];
+  int zone, i, ret = -1;
+
+  if (!thread || sandglass_trace_open(&partial, path, 1e9) != 0) {
+    perror("sandglass_trace_open()");
+    free(thread);
+    return -1;
+  }
+  zone = sandglass_trace_zone(&partial, "zone");
+  sandglass_trace_thread_init(thread, &partial);
+  for (i = 0; i < 100; ++i) {
+    sandglass_trace_record(thread, zone, 1000L*i, 1000L*i + 10);
+  }
+
+  /* Let the header through, but not the whole payload */
+  signal(SIGXFSZ, SIG_IGN);
+  getrlimit(RLIMIT_FSIZE, &old);
+  offset = partial.offset;
+  limit = old;
+  limit.rlim_cur = offset + SANDGLASS_TRACE_CHUNK_SIZE + 10;
+  setrlimit(RLIMIT_FSIZE, &limit);
+  i = sandglass_trace_thread_flush(thread);
+  setrlimit(RLIMIT_FSIZE, &old);
+
+  if (i == 0 || partial.offset != offset) {
+    fprintf(stderr, "Partial chunk wasn't rolled back!\n");
+    sandglass_trace_close(&partial);
+    goto done;
+  }
+
+  /* Retrying appends the chunk where it should have been */
+  if (sandglass_trace_thread_flush(thread) != 0
+      || sandglass_trace_close(&partial) != 0
+      || sandglass_trace_reader_open(&reader, path) != 0) {
+    perror("sandglass_trace_thread_flush()");
+    goto done;
+  }
+  if (reader.nchunks != 1
+      || sandglass_trace_totals(&reader, LLONG_MIN, LLONG_MAX, counts, totals)
+         != 0
+      || counts[0] != 100 || totals[0] != 1000) {
+    fprintf(stderr, "Wrong trace after a failed flush!\n");
+  } else {
+    ret = 0;
+  }
+  sandglass_trace_reader_close(&reader);
+
+ done:
+  free(thread);
+  return ret;
+}
+
+int
+main()
+{
+  sandglass_trace_reader_t reader, corrupt;
+  sandglass_trace_stats_t stats;
+  pthread_t threads[THREADS];
+  char path[] = "trace-test.XXXXXX", copy[] = "trace-test.XXXXXX";
+  unsigned char bad[92], *p;
+  long counts[2], last;
+  long long totals[2];
+  int fd, ret = EXIT_FAILURE;
+  long i;
+
+  fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp()");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  fd = mkstemp(copy);
+  if (fd < 0) {
+    perror("mkstemp()");
+    remove(path);
+    return EXIT_FAILURE;
+  }
+  close(fd);
+
+  if (sandglass_trace_open(&trace, path, 1e9) != 0) {
+    perror("sandglass_trace_open()");
+    goto done;
+  }
+  outer = sandglass_trace_zone(&trace, "outer");
+  inner = sandglass_trace_zone(&trace, "inner");
+
+  for (i = 0; i < THREADS; ++i) {
+    pthread_create(&threads[i], NULL, worker, (void *)i);
+  }
+  for (i = 0; i < THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  if (sandglass_trace_close(&trace) != 0) {
+    perror("sandglass_trace_close()");
+    goto done;
+  }
+
+  if (sandglass_trace_reader_open(&reader, path) != 0) {
+    perror("sandglass_trace_reader_open()");
+    goto done;
+  }
+
+  if (reader.nzones != 2 || reader.freq != 1e9
+      || sandglass_trace_totals(&reader, LLONG_MIN, LLONG_MAX, counts, totals)
+         != 0
+      || counts[outer] != THREADS*ITERATIONS
+      || totals[outer] != 100LL*THREADS*ITERATIONS) {
+    fprintf(stderr, "Wrong totals!\n");
+    goto close;
+  }
+
+  if (sandglass_trace_zone_stats(&reader, inner, LLONG_MIN, LLONG_MAX, &stats)
+        != 0
+      || stats.count != THREADS*ITERATIONS
+      || stats.min != 0 || stats.max != 49
+      || stats.p50 != 24 || stats.p99 != 49) {
+    fprintf(stderr, "Wrong statistics!\n");
+    goto close;
+  }
+
+  /* Only the first iteration of the first thread */
+  if (sandglass_trace_totals(&reader, 0, 999, counts, totals) != 0
+      || counts[outer] != 1 || counts[inner] != 1) {
+    fprintf(stderr, "Wrong time range query!\n");
+    goto close;
+  }
+
+  /* A trace whose writer died before the footer can still be read */
+  if (check_truncated(&reader, copy, reader.chunks_end, reader.nchunks,
+                      2*THREADS*ITERATIONS) != 0)
+    goto close;
+
+  /* Cutting the last chunk short loses just that chunk */
+  p = (unsigned char *)reader.map
+      + sandglass_get_u64(reader.index
+                          + (reader.nchunks - 1)*SANDGLASS_TRACE_ENTRY_SIZE);
+  last = sandglass_get_u32(p + 4);
+  if (check_truncated(&reader, copy, reader.chunks_end - 1,
+                      reader.nchunks - 1, 2*THREADS*ITERATIONS - last) != 0)
+    goto close;
+
+  /* An index entry pointing past the end of the file is reported */
+  memset(bad, 0, sizeof(bad));
+  memcpy(bad, reader.map, SANDGLASS_TRACE_HEADER_SIZE);
+  p = sandglass_put_u32(bad + 24, 0);                /* No zones */
+  p = sandglass_put_u64(p, 1);                       /* One chunk */
+  p = sandglass_put_u64(p, 0xFFFFFFFFFFFFFFF0ULL);   /* At a wild offset */
+  p = sandglass_put_u64(p + 8, 0);
+  p = sandglass_put_u64(p, 1000);
+  p = sandglass_put_u64(p, 24);                      /* Zones offset */
+  p = sandglass_put_u64(p, 28);                      /* Index offset */
+  memcpy(p, SANDGLASS_TRACE_INDEX_MAGIC, 8);
+  if (write_file(copy, bad, sizeof(bad)) != 0
+      || sandglass_trace_reader_open(&corrupt, copy) != 0) {
+    perror("sandglass_trace_reader_open()");
+    goto close;
+  }
+  errno = 0;
+  if (sandglass_trace_totals(&corrupt, LLONG_MIN, LLONG_MAX, counts, totals)
+        != -1
+      || errno != EINVAL) {
+    fprintf(stderr, "Corrupt chunk offset wasn't detected!\n");
+    sandglass_trace_reader_close(&corrupt);
+    goto close;
+  }
+  sandglass_trace_reader_close(&corrupt);
+
+  if (check_rollback(copy) != 0)
+    goto close;
+
+  printf("%ld chunks, %.15g bytes/record\n", reader.nchunks,
+         (double)reader.size/(2*THREADS*ITERATIONS));
+  ret = EXIT_SUCCESS;
+
+ close:
+  sandglass_trace_reader_close(&reader);
+ done:
+  remove(copy);
+  remove(path);
+  return ret;
+}
@@ -0,0 +1,117 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+#include "../src/sandglass-impl.h"
+#include "../src/sandglass.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#if SANDGLASS_TSC
+
+static sandglass_tsc_map_t map;
+static long long reference;
+static long long converted;
+static volatile int done = 0;
+
+/* Convert a fixed tick value while the map is being updated */
+static void *
+reader(void *ptr)
+{
+  long long ns, error;
+  long bad = 0;
+
+  (void)ptr;
+
+  while (!done) {
+    sandglass_tsc_to_monotonic(&map, reference, &ns);
+    error = ns - converted;
+    if (error < -1000000L || error > 1000000L)
+      ++bad;
+  }
+
+  return (void *)bad;
+}
+
+#endif
+
+int
+main()
+{
+#if SANDGLASS_TSC
+  pthread_t thread;
+  void *bad;
+  struct timespec tosleep = { .tv_sec = 0, .tv_nsec = 11111111L };
+  struct timespec ts;
+  long long expected, actual, error, tsc;
+  int i;
+
+  if (sandglass_tsc_map_init(&map) != 0) {
+    perror("sandglass_tsc_map_init()");
+    return EXIT_FAILURE;
+  }
+
+  reference = sandglass_get_tsc();
+  sandglass_tsc_to_monotonic(&map, reference, &converted);
+  if (pthread_create(&thread, NULL, reader, NULL) != 0) {
+    perror("pthread_create()");
+    return EXIT_FAILURE;
+  }
+
+  /* Overflow the table at least once */
+  for (i = 0; i < SANDGLASS_TSC_MAP_POINTS + 8; ++i) {
+    sandglass_spin(&tosleep);
+    if (sandglass_tsc_map_update(&map) != 0) {
+      perror("sandglass_tsc_map_update()");
+      return EXIT_FAILURE;
+    }
+  }
+
+  done = 1;
+  pthread_join(thread, &bad);
+  if (bad) {
+    fprintf(stderr, "Inconsistent conversions during updates!\n");
+    return EXIT_FAILURE;
+  }
+
+  tsc = sandglass_get_tsc();
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  expected = ts.tv_sec*1000000000LL + ts.tv_nsec;
+  if (sandglass_tsc_to_monotonic(&map, tsc, &actual) != 0) {
+    perror("sandglass_tsc_to_monotonic()");
+    return EXIT_FAILURE;
+  }
+
+  error = actual - expected;
+  if (error < 0)
+    error = -error;
+  if (error > 1000000L) {
+    fprintf(stderr, "TSC mapping is off by %lld ns!\n", error);
+    return EXIT_FAILURE;
+  }
+
+  printf("%lld\n", error);
+  return EXIT_SUCCESS;
+#else
+  return EXIT_FAILURE;
+#endif
+}
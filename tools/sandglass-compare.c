@@ -0,0 +1,450 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Sandglass Library.                           *
+ *                                                                       *
+ * The Sandglass Library is free software; you can redistribute it       *
+ * and/or modify it under the terms of the GNU Lesser General Public     *
+ * License as published by the Free Software Foundation; either version  *
+ * 3 of the License, or (at your option) any later version.              *
+ *                                                                       *
+ * The Sandglass Library is distributed in the hope that it will be      *
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty   *
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  *
+ * Lesser General Public License for more details.                       *
+ *                                                                       *
+ * You should have received a copy of the GNU Lesser General Public      *
+ * License along with this program.  If not, see                         *
+ * <http://www.gnu.org/licenses/>.                                       *
+ *************************************************************************/
+
+/*
+ * sandglass-compare - compare two sets of benchmark results, and fail if the
+ * candidate is significantly slower than the baseline.
+ *
+ * Each input line holds a benchmark name (which may include parameters, e.g.
+ * "sort/1024") followed by one measurement.  Repeated names are repetitions of
+ * the same benchmark.  A bare number is a measurement of an unnamed benchmark,
+ * so plain sandglass_bench() output works too.  Blank lines and lines starting
+ * with '#' are ignored.
+ */
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+
+/* A growable array of measurements */
+typedef struct samples_t
+{
+  double *values;
+  size_t size, capacity;
+} samples_t;
+
+/* A benchmark, and its measurements from both files */
+typedef struct benchmark_t
+{
+  char *name;
+  samples_t samples[2];
+} benchmark_t;
+
+/* Every benchmark, in order of first appearance */
+typedef struct benchmarks_t
+{
+  benchmark_t *array;
+  size_t size, capacity;
+} benchmarks_t;
+
+/* Options */
+static double threshold = 5.0;
+static double alpha     = 0.05;
+static long   resamples = 10000;
+static int    allow_missing = 0;
+
+/* Print an error and exit */
+static void
+die(const char *message, const char *arg)
+{
+  fprintf(stderr, "sandglass-compare: %s: %s\n", message, arg);
+  exit(2);
+}
+
+static void *
+xrealloc(void *ptr, size_t size)
+{
+  ptr = realloc(ptr, size);
+  if (!ptr)
+    die("couldn't allocate memory", strerror(errno));
+  return ptr;
+}
+
+static void
+samples_push(samples_t *samples, double value)
+{
+  if (samples->size == samples->capacity) {
+    samples->capacity = samples->capacity ? 2*samples->capacity : 16;
+    samples->values = xrealloc(samples->values,
+                               samples->capacity*sizeof(double));
+  }
+  samples->values[samples->size++] = value;
+}
+
+/* Find or add a benchmark by name */
+static benchmark_t *
+benchmarks_get(benchmarks_t *benchmarks, const char *name)
+{
+  benchmark_t *benchmark;
+  size_t i;
+
+  for (i = 0; i < benchmarks->size; ++i) {
+    if (strcmp(benchmarks->array[i].name, name) == 0)
+      return &benchmarks->array[i];
+  }
+
+  if (benchmarks->size == benchmarks->capacity) {
+    benchmarks->capacity = benchmarks->capacity ? 2*benchmarks->capacity : 16;
+    benchmarks->array = xrealloc(benchmarks->array,
+                                 benchmarks->capacity*sizeof(benchmark_t));
+  }
+
+  benchmark = &benchmarks->array[benchmarks->size++];
+  memset(benchmark, 0, sizeof(*benchmark));
+  benchmark->name = xrealloc(NULL, strlen(name) + 1);
+  strcpy(benchmark->name, name);
+  return benchmark;
+}
+
+/* Read one results file into the given sample slot of each benchmark */
+static void
+read_results(benchmarks_t *benchmarks, const char *path, int which)
+{
+  char line[4096], *begin, *end, *value, *tail;
+  unsigned long lineno = 0;
+  double measurement;
+  FILE *file;
+
+  file = fopen(path, "r");
+  if (!file)
+    die(path, strerror(errno));
+
+  while (fgets(line, sizeof(line), file)) {
+    ++lineno;
+
+    /* Trim whitespace */
+    for (begin = line; isspace((unsigned char)*begin); ++begin);
+    for (end = begin + strlen(begin);
+         end > begin && isspace((unsigned char)end[-1]);
+         --end);
+    *end = '\0';
+
+    if (*begin == '\0' || *begin == '#')
+      continue;
+
+    /* The measurement is the last field */
+    for (value = end; value > begin && !isspace((unsigned char)value[-1]);
+         --value);
+    errno = 0;
+    measurement = strtod(value, &tail);
+    if (errno || tail == value || *tail != '\0') {
+      fprintf(stderr, "sandglass-compare: %s:%lu: invalid measurement '%s'\n",
+              path, lineno, value);
+      exit(2);
+    }
+
+    /* Everything before it is the name */
+    for (end = value; end > begin && isspace((unsigned char)end[-1]); --end);
+    *end = '\0';
+
+    samples_push(&benchmarks_get(benchmarks, begin)->samples[which],
+                 measurement);
+  }
+
+  if (ferror(file))
+    die(path, strerror(errno));
+  fclose(file);
+}
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* Median of a sorted array */
+static double
+median(const double *values, size_t size)
+{
+  if (size % 2) {
+    return values[size/2];
+  } else {
+    return (values[size/2 - 1] + values[size/2])/2.0;
+  }
+}
+
+/* A small, deterministic PRNG (xorshift64*), so results are reproducible */
+static unsigned long long rng_state = 0x9e3779b97f4a7c15ULL;
+
+static size_t
+rng_below(size_t n)
+{
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return ((rng_state*0x2545f4914f6cdd1dULL) >> 11) % n;
+}
+
+/* Median of a bootstrap resample of values into scratch */
+static double
+resample_median(const samples_t *samples, double *scratch)
+{
+  size_t i;
+  for (i = 0; i < samples->size; ++i) {
+    scratch[i] = samples->values[rng_below(samples->size)];
+  }
+  qsort(scratch, samples->size, sizeof(double), compare_doubles);
+  return median(scratch, samples->size);
+}
+
+/* Bootstrap confidence interval for the relative change of the medians */
+static void
+bootstrap(const samples_t *baseline, const samples_t *candidate,
+          double *lo, double *hi)
+{
+  double *changes, *scratch;
+  size_t n = baseline->size > candidate->size ? baseline->size : candidate->size;
+  long i;
+
+  changes = xrealloc(NULL, resamples*sizeof(double));
+  scratch = xrealloc(NULL, n*sizeof(double));
+
+  for (i = 0; i < resamples; ++i) {
+    double a = resample_median(baseline, scratch);
+    double b = resample_median(candidate, scratch);
+    if (a > 0.0) {
+      changes[i] = b/a - 1.0;
+    } else {
+      /* A resample can land on a zero median even if the full sample
+         doesn't */
+      changes[i] = b > 0.0 ? HUGE_VAL : 0.0;
+    }
+  }
+
+  qsort(changes, resamples, sizeof(double), compare_doubles);
+  *lo = changes[(long)(alpha/2.0*(resamples - 1))];
+  *hi = changes[(long)((1.0 - alpha/2.0)*(resamples - 1))];
+
+  free(scratch);
+  free(changes);
+}
+
+/* A measurement, remembering which file it came from */
+typedef struct tagged_t
+{
+  double value;
+  int baseline;
+} tagged_t;
+
+static int
+compare_tagged(const void *a, const void *b)
+{
+  return compare_doubles(&((const tagged_t *)a)->value,
+                         &((const tagged_t *)b)->value);
+}
+
+/* Two-sided p-value of the Mann-Whitney U test, by normal approximation */
+static double
+mann_whitney(const samples_t *baseline, const samples_t *candidate)
+{
+  size_t n1 = baseline->size, n2 = candidate->size, n = n1 + n2, i, j;
+  double rank, r1 = 0.0, ties = 0.0, t, u, mean, var, z;
+  tagged_t *tagged;
+
+  tagged = xrealloc(NULL, n*sizeof(tagged_t));
+  for (i = 0; i < n1; ++i) {
+    tagged[i].value    = baseline->values[i];
+    tagged[i].baseline = 1;
+  }
+  for (i = 0; i < n2; ++i) {
+    tagged[n1 + i].value    = candidate->values[i];
+    tagged[n1 + i].baseline = 0;
+  }
+  qsort(tagged, n, sizeof(tagged_t), compare_tagged);
+
+  /* Sum the baseline's ranks, giving runs of ties their average rank */
+  for (i = 0; i < n; i = j) {
+    for (j = i + 1; j < n && tagged[j].value == tagged[i].value; ++j);
+    t = j - i;
+    ties += t*t*t - t;
+    rank = (i + j + 1)/2.0;
+    for (; i < j; ++i) {
+      if (tagged[i].baseline)
+        r1 += rank;
+    }
+  }
+  free(tagged);
+
+  u    = r1 - n1*(n1 + 1)/2.0;
+  mean = n1*n2/2.0;
+  var  = n1*n2/12.0*((n + 1) - ties/(n*(n - 1.0)));
+  if (var <= 0.0) {
+    /* Every value is the same */
+    return 1.0;
+  }
+
+  /* With continuity correction */
+  z = (fabs(u - mean) - 0.5)/sqrt(var);
+  if (z < 0.0)
+    z = 0.0;
+  return erfc(z/sqrt(2.0));
+}
+
+static void
+usage(FILE *file)
+{
+  fprintf(file,
+          "Usage: sandglass-compare [OPTION]... BASELINE CANDIDATE\n"
+          "Compare benchmark results, failing on significant regressions.\n"
+          "\n"
+          "  -t, --threshold=PERCENT  tolerated slowdown (default %g)\n"
+          "  -a, --alpha=ALPHA        significance level (default %g)\n"
+          "  -b, --bootstrap=N        bootstrap resamples (default %ld)\n"
+          "  -m, --allow-missing      don't fail on benchmarks in only one file\n"
+          "      --help               display this help and exit\n"
+          "      --version            output version information and exit\n"
+          "\n"
+          "Exit status is 0 if there are no regressions, 1 if there are, and 2\n"
+          "on errors, including benchmarks missing from either file.\n",
+          threshold, alpha, resamples);
+}
+
+int
+main(int argc, char *argv[])
+{
+  static const struct option options[] = {
+    { "threshold",     required_argument, NULL, 't' },
+    { "alpha",         required_argument, NULL, 'a' },
+    { "bootstrap",     required_argument, NULL, 'b' },
+    { "allow-missing", no_argument,       NULL, 'm' },
+    { "help",          no_argument,       NULL, 'h' },
+    { "version",       no_argument,       NULL, 'V' },
+    { NULL, 0, NULL, 0 }
+  };
+  benchmarks_t benchmarks = { NULL, 0, 0 };
+  int opt, regressions = 0, errors = 0;
+  size_t i;
+  char *tail;
+
+  while ((opt = getopt_long(argc, argv, "t:a:b:m", options, NULL)) != -1) {
+    switch (opt) {
+    case 't':
+      threshold = strtod(optarg, &tail);
+      if (*tail || threshold < 0.0)
+        die("invalid threshold", optarg);
+      break;
+
+    case 'a':
+      alpha = strtod(optarg, &tail);
+      if (*tail || alpha <= 0.0 || alpha >= 1.0)
+        die("invalid significance level", optarg);
+      break;
+
+    case 'b':
+      resamples = strtol(optarg, &tail, 10);
+      if (*tail || resamples < 1)
+        die("invalid number of resamples", optarg);
+      break;
+
+    case 'm':
+      allow_missing = 1;
+      break;
+
+    case 'h':
+      usage(stdout);
+      return EXIT_SUCCESS;
+
+    case 'V':
+      printf("sandglass-compare (%s) %s\n", PACKAGE_NAME, PACKAGE_VERSION);
+      return EXIT_SUCCESS;
+
+    default:
+      usage(stderr);
+      return 2;
+    }
+  }
+
+  if (argc - optind != 2) {
+    usage(stderr);
+    return 2;
+  }
+
+  read_results(&benchmarks, argv[optind], 0);
+  read_results(&benchmarks, argv[optind + 1], 1);
+
+  printf("%-32s %12s %12s %9s %21s %8s\n",
+         "benchmark", "baseline", "candidate", "change", "confidence interval",
+         "p");
+
+  for (i = 0; i < benchmarks.size; ++i) {
+    benchmark_t *benchmark = &benchmarks.array[i];
+    samples_t *baseline = &benchmark->samples[0];
+    samples_t *candidate = &benchmark->samples[1];
+    const char *name = *benchmark->name ? benchmark->name : "(unnamed)";
+    const char *verdict = "";
+    double a, b, change, lo, hi, p;
+
+    if (baseline->size == 0 || candidate->size == 0) {
+      /* A benchmark that crashed or was dropped mustn't pass silently */
+      fprintf(stderr, "sandglass-compare: %s: only in %s\n",
+              name, argv[optind + (baseline->size == 0)]);
+      if (!allow_missing)
+        ++errors;
+      continue;
+    }
+
+    qsort(baseline->values, baseline->size, sizeof(double), compare_doubles);
+    qsort(candidate->values, candidate->size, sizeof(double), compare_doubles);
+    a = median(baseline->values, baseline->size);
+    b = median(candidate->values, candidate->size);
+    if (a <= 0.0) {
+      /* A relative change from zero is meaningless */
+      fprintf(stderr, "sandglass-compare: %s: baseline median is %g\n",
+              name, a);
+      ++errors;
+      continue;
+    }
+    change = b/a - 1.0;
+
+    if (baseline->size < 2 || candidate->size < 2) {
+      /* Nothing to test; gate on the change alone */
+      printf("%-32s %12.6g %12.6g %+8.2f%% %21s %8s", name, a, b,
+             100.0*change, "", "");
+      if (100.0*change > threshold) {
+        verdict = "  regression";
+        ++regressions;
+      }
+      printf("%s\n", verdict);
+      continue;
+    }
+
+    bootstrap(baseline, candidate, &lo, &hi);
+    p = mann_whitney(baseline, candidate);
+
+    if (p < alpha && 100.0*change > threshold) {
+      verdict = "  regression";
+      ++regressions;
+    } else if (p < alpha && 100.0*change < -threshold) {
+      verdict = "  improvement";
+    }
+
+    printf("%-32s %12.6g %12.6g %+8.2f%% [%+8.2f%%, %+8.2f%%] %8.2g%s\n",
+           name, a, b, 100.0*change, 100.0*lo, 100.0*hi, p, verdict);
+  }
+
+  if (errors)
+    return 2;
+  return regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+}